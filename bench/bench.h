@@ -0,0 +1,32 @@
+/**********************************************************************
+ * Tiny helpers shared by the microbenchmarks under bench/
+ *
+ * The microbenchmarks build mipsasm.c as part of their own translation
+ * unit so the static helpers (detectType(), parse_command(), ...) are
+ * reachable. Those that also need pa1.c's helpers include it with its
+ * main() renamed out of the way.
+ **********************************************************************/
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Keep the compiler from discarding results we only time */
+static volatile uint64_t bench_sink;
+
+static inline void consume(uint64_t v)
+{
+	bench_sink += v;
+}
+
+#endif
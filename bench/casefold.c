@@ -0,0 +1,90 @@
+/**********************************************************************
+ * Per-line cost of the former lowercase pass in main() against folding
+ * case inside the lookups
+ *
+ *   make bench-casefold
+ **********************************************************************/
+#include "bench.h"
+
+#include "../mipsasm.c"
+
+static const char *const corpus[] = {
+	"add t0 t1 t2",
+	"ADDI SP SP -0x10",
+	"Sll S2 s2 0x1D",
+	"lw s0 0x7ee8 s1",
+	"BEQ zero AT 0x2eef",
+	"sw s4 -0x0072 s1    /* Spill S4 */",
+};
+#define NR_CORPUS (sizeof(corpus) / sizeof(corpus[0]))
+#define ITERS 1000000
+
+/* The loop main() ran on every line, strlen() in the condition and all */
+static void fold_line(char *assembly)
+{
+	for (size_t i = 0; i < strlen(assembly); i++)
+	{
+		assembly[i] = tolower(assembly[i]);
+	}
+}
+
+static unsigned int parse_and_translate(const char *line, size_t len)
+{
+	Token tokens[MAX_NR_TOKENS];
+	uint32_t word;
+	int nr_tokens;
+
+	parse_command(line, len, &nr_tokens, tokens);
+	translate(nr_tokens, tokens, &word);
+	return word;
+}
+
+int main(void)
+{
+	double fold = 0, folded = 0, raw = 0;
+	char line[128];
+
+	for (size_t i = 0; i < NR_CORPUS; i++)
+	{
+		size_t len = strlen(corpus[i]);
+		uint64_t start, acc = 0;
+
+		start = now_ns();
+		for (int n = 0; n < ITERS; n++)
+		{
+			memcpy(line, corpus[i], len + 1);
+			fold_line(line);
+			acc += line[0];
+		}
+		fold += (double)(now_ns() - start) / ITERS;
+
+		/* line holds the lowercased copy now */
+		start = now_ns();
+		for (int n = 0; n < ITERS; n++)
+			acc += parse_and_translate(line, len);
+		folded += (double)(now_ns() - start) / ITERS;
+
+		memcpy(line, corpus[i], len + 1);
+		start = now_ns();
+		for (int n = 0; n < ITERS; n++)
+			acc += parse_and_translate(line, len);
+		raw += (double)(now_ns() - start) / ITERS;
+		consume(acc);
+
+		acc = parse_and_translate(line, len);
+		fold_line(line);
+		if (acc != parse_and_translate(line, len))
+		{
+			fprintf(stderr, "mismatch on %s\n", corpus[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("%-34s %8s\n", "stage (mean over corpus)", "ns/line");
+	printf("%-34s %8.2f\n", "lowercase pass (before)", fold / NR_CORPUS);
+	printf("%-34s %8.2f\n", "parse+translate, pre-lowercased", folded / NR_CORPUS);
+	printf("%-34s %8.2f\n", "parse+translate, folding lookups", raw / NR_CORPUS);
+	printf("%-34s %8.2f -> %.2f\n", "line total", (fold + folded) / NR_CORPUS, raw / NR_CORPUS);
+
+	return EXIT_SUCCESS;
+}
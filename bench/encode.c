@@ -0,0 +1,169 @@
+/**********************************************************************
+ * Randomized equivalence of pack_columns() and pack_scalar(), and their
+ * ns/word
+ *
+ *   bench/encode [-n ROUNDS] [-s SEED]
+ *   make bench-encode
+ *
+ * pack_columns() uses the widest vectors the build targets, so build with
+ * e.g. BENCH_CFLAGS="-O2 -mavx2" or "-O2 -mavx512f" to check those paths;
+ * make test-encode checks every width the machine has.
+ * Every round fills the columns with random fields of random instructions
+ * and packs a random number of lanes both ways; then random lines, errors
+ * included, go through mipsasm_translate_buffer() and are checked against
+ * mipsasm_translate_line().
+ **********************************************************************/
+#include "bench.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../mipsasm.c"
+
+#define PASSES 20000
+
+static uint64_t state;
+
+/* splitmix64 */
+static uint64_t next_random(void)
+{
+	uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static uint32_t columns[NR_COLUMNS][DECODE_BATCH];
+
+static void fill_columns(const uint32_t bases[], int nr_bases)
+{
+	for (int i = 0; i < DECODE_BATCH; i++)
+	{
+		columns[COLUMN_BASE][i] = bases[next_random() % nr_bases];
+		for (int f = 0; f < NR_FIELDS; f++)
+			columns[f][i] = (uint32_t)next_random() & fields[f].mask;
+	}
+}
+
+static double run(void (*pack)(const uint32_t *, size_t, size_t, uint32_t[]))
+{
+	uint32_t words[DECODE_BATCH];
+	uint64_t start = now_ns();
+	uint64_t acc = 0;
+
+	for (int p = 0; p < PASSES; p++)
+	{
+		pack(&columns[0][0], DECODE_BATCH, DECODE_BATCH, words);
+		acc += words[p % DECODE_BATCH];
+	}
+	consume(acc);
+	return (double)(now_ns() - start) / ((uint64_t)PASSES * DECODE_BATCH);
+}
+
+static const char *const mnemonic_mix[] = {
+	"add", "sub", "and", "or", "nor", "sll", "srl", "sra",
+	"addi", "andi", "ori", "lw", "sw", "beq", "bne", "xor",
+};
+
+static const char *const operand_mix[] = {
+	"t0", "zero", "ra", "S7", "x9", "0", "31", "32", "-1",
+	"0x1f", "0xffff", "-0x8000", "-0x8001", "0x10000", "abc",
+};
+
+#define NR_MIX(mix) (sizeof(mix) / sizeof(mix[0]))
+
+/* Random lines of 0 to 4 tokens from the mixes above into @buf */
+static size_t fill_lines(char *buf, int nr_lines)
+{
+	size_t len = 0;
+
+	for (int l = 0; l < nr_lines; l++)
+	{
+		int nr_tokens = next_random() % 5;
+
+		for (int t = 0; t < nr_tokens; t++)
+		{
+			const char *token = t == 0 ? mnemonic_mix[next_random() % NR_MIX(mnemonic_mix)]
+									   : operand_mix[next_random() % NR_MIX(operand_mix)];
+
+			len += sprintf(buf + len, t == 0 ? "%s" : " %s", token);
+		}
+		buf[len++] = '\n';
+	}
+	return len;
+}
+
+int main(int argc, char *argv[])
+{
+	static char text[DECODE_BATCH * 64];
+	uint32_t bases[32], expected[DECODE_BATCH], words[DECODE_BATCH];
+	uint8_t status[DECODE_BATCH];
+	int nr_bases = 0, rounds = 10000, opt;
+
+	state = 1;
+	while ((opt = getopt(argc, argv, "n:s:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			rounds = atoi(optarg);
+			break;
+		case 's':
+			state = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n ROUNDS] [-s SEED]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (int i = 0; i < 32; i++)
+		if (mnemonics[i].key)
+			bases[nr_bases++] = mnemonics[i].info.base;
+
+	for (int r = 0; r < rounds; r++)
+	{
+		size_t nr = next_random() % (DECODE_BATCH + 1), consumed;
+		const char *line;
+
+		fill_columns(bases, nr_bases);
+		pack_scalar(&columns[0][0], DECODE_BATCH, nr, expected);
+		pack_columns(&columns[0][0], DECODE_BATCH, nr, words);
+		if (memcmp(expected, words, nr * sizeof(*words)) != 0)
+		{
+			fprintf(stderr, "pack mismatch in round %d\n", r);
+			return EXIT_FAILURE;
+		}
+
+		nr = mipsasm_translate_buffer(text, fill_lines(text, nr), words, status, DECODE_BATCH,
+									  &consumed, NULL);
+		line = text;
+		for (size_t i = 0; i < nr; i++)
+		{
+			const char *eol = strchr(line, '\n');
+			uint32_t word;
+
+			if (mipsasm_translate_line(line, eol - line, &word) != status[i] || word != words[i])
+			{
+				fprintf(stderr, "buffer mismatch in round %d on \"%.*s\"\n", r, (int)(eol - line), line);
+				return EXIT_FAILURE;
+			}
+			line = eol + 1;
+		}
+	}
+	printf("%d rounds equivalent, %d lanes per vector\n", rounds,
+#ifdef PACK_LANES
+		   PACK_LANES
+#else
+		   1
+#endif
+	);
+
+	fill_columns(bases, nr_bases);
+	printf("%-14s %8s\n", "packer", "ns/word");
+	printf("%-14s %8.2f\n", "pack_scalar", run(pack_scalar));
+	printf("%-14s %8.2f\n", "pack_columns", run(pack_columns));
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,265 @@
+/**********************************************************************
+ * Deterministic generator of synthetic pa1 input
+ *
+ *   bench/gencorpus [-n LINES] [-s SEED] [-u UNIQUE] [-m MIX] [-r REGS] [-f FORMS] [-o FILE]
+ *
+ *   -n  number of lines; k and M suffixes are accepted (default 1M)
+ *   -s  seed; the same seed and options give the same corpus (default 1)
+ *   -u  draw every line from a pool of UNIQUE distinct lines, the way code
+ *       generators repeat spills and stack adjustments (default: no pool)
+ *   -m  mnemonic weights, e.g. add=4,lw=2,beq=1 (default: all 15 equally)
+ *   -r  registers to draw operands from, e.g. t0,t1,sp (default: all 32)
+ *   -f  immediate form weights over dec, neg, hex and neghex, e.g. 10,
+ *       -22, 0x1d and -0x42 (default: all equally)
+ **********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+enum
+{
+	OPERANDS_RRR, /* add rd rs rt */
+	OPERANDS_RRS, /* sll rd rt shamt */
+	OPERANDS_RRI, /* addi rt rs imm */
+	OPERANDS_RIR, /* lw rt imm rs */
+};
+
+static const struct
+{
+	const char *name;
+	int operands;
+} mnemonics[] = {
+	{"add", OPERANDS_RRR}, {"sub", OPERANDS_RRR}, {"and", OPERANDS_RRR},
+	{"or", OPERANDS_RRR}, {"nor", OPERANDS_RRR},
+	{"sll", OPERANDS_RRS}, {"srl", OPERANDS_RRS}, {"sra", OPERANDS_RRS},
+	{"addi", OPERANDS_RRI}, {"andi", OPERANDS_RRI}, {"ori", OPERANDS_RRI},
+	{"lw", OPERANDS_RIR}, {"sw", OPERANDS_RIR},
+	{"beq", OPERANDS_RRI}, {"bne", OPERANDS_RRI},
+};
+#define NR_MNEMONICS (sizeof(mnemonics) / sizeof(mnemonics[0]))
+
+static const char *registers[32] = {
+	"zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+	"t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+	"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+	"t8", "t9", "k1", "k2", "gp", "sp", "fp", "ra"};
+
+static const char *forms[] = {"dec", "neg", "hex", "neghex"};
+#define NR_FORMS 4
+
+/* splitmix64: tiny, and the same sequence on every platform */
+static uint64_t state;
+
+static uint64_t next_random(void)
+{
+	uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static unsigned int random_below(unsigned int n)
+{
+	return (unsigned int)(((next_random() >> 32) * n) >> 32);
+}
+
+/* Pick an index with probability proportional to its weight */
+static int pick(const unsigned int *weights, int n, unsigned int total)
+{
+	unsigned int r = random_below(total);
+	int i = 0;
+
+	while (i < n - 1 && r >= weights[i])
+		r -= weights[i++];
+	return i;
+}
+
+/* Parse "name=weight,..." against @names into @weights; return the total */
+static unsigned int parse_weights(const char *arg, const char *const *names, int n,
+								  unsigned int *weights)
+{
+	char *copy = strdup(arg);
+	unsigned int total = 0;
+
+	memset(weights, 0, n * sizeof(*weights));
+	for (char *item = strtok(copy, ","); item; item = strtok(NULL, ","))
+	{
+		char *eq = strchr(item, '=');
+		int i;
+
+		if (eq)
+			*eq = '\0';
+		for (i = 0; i < n && strcmp(item, names[i]) != 0; i++)
+			;
+		if (i == n)
+		{
+			fprintf(stderr, "unknown name %s\n", item);
+			exit(EXIT_FAILURE);
+		}
+		weights[i] = eq ? strtoul(eq + 1, NULL, 10) : 1;
+	}
+	free(copy);
+
+	for (int i = 0; i < n; i++)
+		total += weights[i];
+	if (total == 0)
+	{
+		fprintf(stderr, "all weights are zero in %s\n", arg);
+		exit(EXIT_FAILURE);
+	}
+	return total;
+}
+
+static unsigned long parse_count(const char *arg)
+{
+	char *end;
+	unsigned long n = strtoul(arg, &end, 10);
+
+	if (*end == 'k' || *end == 'K')
+		n *= 1000;
+	else if (*end == 'm' || *end == 'M')
+		n *= 1000000;
+	return n;
+}
+
+/* shamt only takes the non-negative forms */
+static void put_immediate(FILE *out, int form, int shamt)
+{
+	int value = shamt ? (int)random_below(32) : (int)random_below(0x8000);
+
+	switch (shamt ? form & 2 : form)
+	{
+	case 0:
+		fprintf(out, "%d", value);
+		break;
+	case 1:
+		fprintf(out, "-%d", value + 1);
+		break;
+	case 2:
+		fprintf(out, "0x%x", shamt ? value : value * 2 + (int)random_below(2));
+		break;
+	case 3:
+		fprintf(out, "-0x%x", value + 1);
+		break;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *mnemonic_names[NR_MNEMONICS];
+	unsigned int mnemonic_weights[NR_MNEMONICS], form_weights[NR_FORMS];
+	unsigned int mnemonic_total, form_total;
+	const char *regs[32];
+	int nr_regs = 32;
+	unsigned long lines = 1000000;
+	unsigned int unique = 0;
+	uint64_t seed = 1;
+	FILE *out = stdout;
+	int opt;
+
+	for (size_t i = 0; i < NR_MNEMONICS; i++)
+	{
+		mnemonic_names[i] = mnemonics[i].name;
+		mnemonic_weights[i] = 1;
+	}
+	mnemonic_total = NR_MNEMONICS;
+	for (int i = 0; i < NR_FORMS; i++)
+		form_weights[i] = 1;
+	form_total = NR_FORMS;
+	memcpy(regs, registers, sizeof(regs));
+
+	while ((opt = getopt(argc, argv, "n:s:u:m:r:f:o:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			lines = parse_count(optarg);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'u':
+			unique = parse_count(optarg);
+			break;
+		case 'm':
+			mnemonic_total = parse_weights(optarg, mnemonic_names, NR_MNEMONICS, mnemonic_weights);
+			break;
+		case 'r':
+			nr_regs = 0;
+			for (char *name = strtok(strdup(optarg), ","); name && nr_regs < 32; name = strtok(NULL, ","))
+				regs[nr_regs++] = name;
+			break;
+		case 'f':
+			form_total = parse_weights(optarg, forms, NR_FORMS, form_weights);
+			break;
+		case 'o':
+			out = fopen(optarg, "w");
+			if (!out)
+			{
+				perror(optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n LINES] [-s SEED] [-u UNIQUE] [-m MIX] [-r REGS] [-f FORMS] [-o FILE]\n",
+					argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (nr_regs == 0)
+	{
+		fprintf(stderr, "no registers given\n");
+		return EXIT_FAILURE;
+	}
+
+	state = seed;
+	for (unsigned long n = 0; n < lines; n++)
+	{
+		uint64_t resume = 0;
+		int m, form;
+		const char *r1, *r2;
+
+		/* Pool line k always comes out of the same stream, seeded by k */
+		if (unique)
+		{
+			uint64_t k = random_below(unique);
+
+			resume = state;
+			state = seed ^ (k + 1) * 0xd1b54a32d192ed03ull;
+		}
+
+		m = pick(mnemonic_weights, NR_MNEMONICS, mnemonic_total);
+		r1 = regs[random_below(nr_regs)];
+		r2 = regs[random_below(nr_regs)];
+		form = pick(form_weights, NR_FORMS, form_total);
+
+		fprintf(out, "%s %s ", mnemonics[m].name, r1);
+		switch (mnemonics[m].operands)
+		{
+		case OPERANDS_RRR:
+			fprintf(out, "%s %s", r2, regs[random_below(nr_regs)]);
+			break;
+		case OPERANDS_RRS:
+			fprintf(out, "%s ", r2);
+			put_immediate(out, form, 1);
+			break;
+		case OPERANDS_RRI:
+			fprintf(out, "%s ", r2);
+			put_immediate(out, form, 0);
+			break;
+		case OPERANDS_RIR:
+			put_immediate(out, form, 0);
+			fprintf(out, " %s", r2);
+			break;
+		}
+		fputc('\n', out);
+
+		if (unique)
+			state = resume;
+	}
+
+	return fclose(out) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,81 @@
+/**********************************************************************
+ * ns/immediate of getImmediate() against strtol() on mixed immediates
+ *
+ *   make bench-immediate
+ **********************************************************************/
+#include "bench.h"
+
+#include "../mipsasm.c"
+
+static const char *const corpus[] = {
+	"0", "3", "17", "-4", "512", "-22", "32767", "-32768", "65535",
+	"0x1d", "0x25", "-0x10", "-0x42", "0x7ee8", "-0x0072", "0x2eef", "-0x4bad", "0xFFFF",
+};
+#define NR_CORPUS (sizeof(corpus) / sizeof(corpus[0]))
+#define ROUNDS 200000
+
+/* getImmediate() before: strtol() on a NUL-terminated copy of the token */
+static int strtol_copy(const Token *token, int *value)
+{
+	char buf[33];
+	int len = token->len < 32 ? token->len : 32;
+
+	memcpy(buf, token->str, len);
+	buf[len] = '\0';
+	*value = (int)strtol(buf, NULL, 0);
+	return IMM_OK;
+}
+
+/* strtol() alone, as if tokens were still NUL-terminated */
+static int strtol_only(const Token *token, int *value)
+{
+	*value = (int)strtol(token->str, NULL, 0);
+	return IMM_OK;
+}
+
+static double run(int (*parse)(const Token *, int *), const Token *tokens)
+{
+	uint64_t start = now_ns();
+	uint64_t acc = 0;
+
+	for (int r = 0; r < ROUNDS; r++)
+	{
+		for (size_t i = 0; i < NR_CORPUS; i++)
+		{
+			int value = 0;
+
+			acc += parse(&tokens[i], &value) + value;
+		}
+	}
+	consume(acc);
+	return (double)(now_ns() - start) / (ROUNDS * NR_CORPUS);
+}
+
+int main(void)
+{
+	static char text[NR_CORPUS][32];
+	Token tokens[NR_CORPUS];
+
+	for (size_t i = 0; i < NR_CORPUS; i++)
+	{
+		int expected, value;
+
+		strcpy(text[i], corpus[i]);
+		tokens[i].str = text[i];
+		tokens[i].len = strlen(text[i]);
+
+		strtol_copy(&tokens[i], &expected);
+		if (getImmediate(&tokens[i], &value) != IMM_OK || value != expected)
+		{
+			fprintf(stderr, "mismatch on %s\n", corpus[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("%-24s %8s\n", "parser", "ns/imm");
+	printf("%-24s %8.2f\n", "strtol", run(strtol_only, tokens));
+	printf("%-24s %8.2f\n", "copy + strtol (before)", run(strtol_copy, tokens));
+	printf("%-24s %8.2f\n", "getImmediate", run(getImmediate, tokens));
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+/**********************************************************************
+ * Throughput of the public libmipsasm API over a corpus
+ *
+ *   bench/library [-p PASSES] CORPUS
+ *   make bench-library
+ *
+ * Only mipsasm.h is used, and the binary links against libmipsasm.a, so
+ * this measures what a client of the library gets.
+ **********************************************************************/
+#include "bench.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../mipsasm.h"
+
+#define BATCH_LINES 4096
+
+/* mipsasm_translate_line() on each line, split by the caller */
+static uint64_t run_lines(const char *buf, size_t len, size_t *nr_lines)
+{
+	const char *line = buf, *end = buf + len;
+	uint64_t acc = 0;
+
+	*nr_lines = 0;
+	while (line < end)
+	{
+		const char *eol = memchr(line, '\n', end - line);
+		uint32_t word;
+
+		if (!eol)
+			eol = end;
+		acc += mipsasm_translate_line(line, eol - line, &word) + word;
+		(*nr_lines)++;
+		line = eol + 1;
+	}
+	return acc;
+}
+
+/* mipsasm_translate_buffer() over the whole corpus, BATCH_LINES at a time */
+static uint64_t run_buffer(const char *buf, size_t len, size_t *nr_lines)
+{
+	static uint32_t words[BATCH_LINES];
+	static uint8_t status[BATCH_LINES];
+	uint64_t acc = 0;
+
+	*nr_lines = 0;
+	while (len > 0)
+	{
+		size_t consumed;
+		size_t nr = mipsasm_translate_buffer(buf, len, words, status, BATCH_LINES, &consumed, NULL);
+
+		acc += words[nr - 1] + status[0];
+		*nr_lines += nr;
+		buf += consumed;
+		len -= consumed;
+	}
+	return acc;
+}
+
+static void report(const char *name, uint64_t (*run)(const char *, size_t, size_t *),
+				   const char *buf, size_t len, int passes)
+{
+	uint64_t best = UINT64_MAX;
+	size_t nr_lines = 0;
+
+	for (int p = 0; p < passes; p++)
+	{
+		uint64_t start = now_ns(), elapsed;
+
+		consume(run(buf, len, &nr_lines));
+		elapsed = now_ns() - start;
+		if (elapsed < best)
+			best = elapsed;
+	}
+	printf("%-24s %10.2f %14.0f %10.2f\n", name, (double)best / nr_lines,
+		   nr_lines / (best / 1e9), len / (best / 1e9) / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	struct stat st;
+	const char *map;
+	int passes = 5, opt, fd;
+
+	while ((opt = getopt(argc, argv, "p:")) != -1)
+	{
+		if (opt != 'p')
+			goto usage;
+		passes = atoi(optarg);
+	}
+	if (optind != argc - 1 || passes < 1)
+		goto usage;
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0)
+	{
+		fprintf(stderr, "cannot read %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return EXIT_FAILURE;
+
+	printf("%-24s %10s %14s %10s\n", "api", "ns/line", "lines/s", "MB/s");
+	report("mipsasm_translate_line", run_lines, map, st.st_size, passes);
+	report("mipsasm_translate_buffer", run_buffer, map, st.st_size, passes);
+
+	munmap((void *)map, st.st_size);
+	return EXIT_SUCCESS;
+
+usage:
+	fprintf(stderr, "Usage: %s [-p PASSES] CORPUS\n", argv[0]);
+	return EXIT_FAILURE;
+}
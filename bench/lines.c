@@ -0,0 +1,203 @@
+/**********************************************************************
+ * Randomized equivalence of index_lines() and index_seek(), and their
+ * GB/s against a memchr() loop
+ *
+ *   bench/lines [-n ROUNDS] [-s SEED] [-r RUNS] [CORPUS]
+ *   make bench-lines
+ *
+ * Every round indexes a random buffer of short, long and blank lines,
+ * whitespace, NULs and maybe no last '\n' both ways and seeks to random
+ * lines. With CORPUS, the best of RUNS (default 5) passes of counting its
+ * lines with memchr(), of index_lines() and of index_lines() keeping the
+ * marks is reported. Build with BENCH_CFLAGS="-O2 -mavx2" for the AVX2
+ * blocks.
+ **********************************************************************/
+#include "bench.h"
+
+#include "../mipsasm.c"
+
+#define main pa1_main
+#include "../pa1.c"
+#undef main
+
+static uint64_t state;
+
+/* splitmix64 */
+static uint64_t next_random(void)
+{
+	uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static const char bytes[] = " \t\v\f\r\n\n\n\0xy0";
+
+/* Byte at a time, as translate_line() sees the lines */
+static void index_reference(const char *buf, size_t len, struct line_index *index, size_t starts[])
+{
+	bool ink = false;
+
+	*index = (struct line_index){0};
+	for (size_t pos = 0; pos < len; pos++)
+	{
+		if (pos == 0 || buf[pos - 1] == '\n')
+			starts[index->nr_lines] = pos;
+		if (buf[pos] == '\n')
+		{
+			index->nr_lines++;
+			index->nr_words += ink;
+			ink = false;
+		}
+		else if (!isspace((unsigned char)buf[pos]))
+		{
+			ink = true;
+		}
+	}
+	if (len > 0 && buf[len - 1] != '\n')
+	{
+		index->nr_lines++;
+		index->nr_words += ink;
+	}
+}
+
+static size_t count_memchr(const char *buf, size_t len)
+{
+	const char *curr = buf, *end = buf + len;
+	size_t nr_lines = 0;
+
+	while (curr < end)
+	{
+		const char *eol = memchr(curr, '\n', end - curr);
+
+		nr_lines++;
+		curr = eol ? eol + 1 : end;
+	}
+	return nr_lines;
+}
+
+static int check(int rounds)
+{
+	static char buf[1 << 16];
+	static size_t starts[1 << 16];
+
+	for (int r = 0; r < rounds; r++)
+	{
+		size_t len = next_random() % sizeof(buf);
+		int blankness = next_random() % 4;
+		struct line_index expected, index;
+
+		for (size_t i = 0; i < len; i++)
+		{
+			buf[i] = bytes[next_random() % (sizeof(bytes) - 1 - blankness)];
+		}
+		index_reference(buf, len, &expected, starts);
+		if (index_lines(buf, len, &index, true) < 0)
+			return -1;
+
+		if (index.nr_lines != expected.nr_lines || index.nr_words != expected.nr_words)
+		{
+			fprintf(stderr, "round %d: %zu lines %zu words, expected %zu lines %zu words\n", r, index.nr_lines,
+					index.nr_words, expected.nr_lines, expected.nr_words);
+			return -1;
+		}
+		for (int i = 0; i < 64 && expected.nr_lines > 0; i++)
+		{
+			size_t line = next_random() % expected.nr_lines;
+
+			if (index_seek(&index, buf, len, line) != buf + starts[line])
+			{
+				fprintf(stderr, "round %d: line %zu found at the wrong place\n", r, line);
+				return -1;
+			}
+		}
+		if (index_seek(&index, buf, len, expected.nr_lines) != NULL)
+		{
+			fprintf(stderr, "round %d: found a line past the end\n", r);
+			return -1;
+		}
+		free(index.marks);
+	}
+	return 0;
+}
+
+static double best_gbps(const char *map, size_t size, int runs, int how)
+{
+	uint64_t best = UINT64_MAX;
+
+	for (int r = 0; r < runs; r++)
+	{
+		uint64_t start = now_ns(), ns;
+		struct line_index index = {0};
+
+		if (how == 0)
+			index.nr_lines = count_memchr(map, size);
+		else if (index_lines(map, size, &index, how == 2) < 0)
+			return 0;
+		consume(index.nr_lines + index.nr_words);
+		ns = now_ns() - start;
+		free(index.marks);
+		if (ns < best)
+			best = ns;
+	}
+	return size / (double)best;
+}
+
+int main(int argc, char *argv[])
+{
+	int rounds = 2000, runs = 5, opt;
+	struct stat st;
+	char *map;
+	int fd;
+
+	state = 1;
+	while ((opt = getopt(argc, argv, "n:s:r:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			rounds = atoi(optarg);
+			break;
+		case 's':
+			state = strtoull(optarg, NULL, 0);
+			break;
+		case 'r':
+			runs = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind < argc - 1 || runs < 1)
+		goto usage;
+
+	if (check(rounds) < 0)
+		return EXIT_FAILURE;
+	printf("%d rounds equivalent, %d bytes per block\n", rounds,
+#ifdef LINE_BLOCK
+		   LINE_BLOCK
+#else
+		   1
+#endif
+	);
+	if (optind == argc)
+		return EXIT_SUCCESS;
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0 ||
+		(map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+	{
+		fprintf(stderr, "cannot map %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	printf("%-14s %8s\n", "scan", "GB/s");
+	printf("%-14s %8.2f\n", "memchr", best_gbps(map, st.st_size, runs, 0));
+	printf("%-14s %8.2f\n", "index_lines", best_gbps(map, st.st_size, runs, 1));
+	printf("%-14s %8.2f\n", "+ marks", best_gbps(map, st.st_size, runs, 2));
+	return EXIT_SUCCESS;
+
+usage:
+	fprintf(stderr, "Usage: %s [-n ROUNDS] [-s SEED] [-r RUNS] [CORPUS]\n", argv[0]);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,187 @@
+/**********************************************************************
+ * ns/lookup of detectType() and getRegisterNum() against the former
+ * linear strcmp scans, after checking that every entry of MIPS_ISA and
+ * MIPS_REGISTERS is found and that tokens with a NUL in them look up
+ * nothing
+ *
+ *   bench/lookup [-c]
+ *   make bench-lookup
+ *
+ * With -c only the checks are run.
+ **********************************************************************/
+#include "bench.h"
+
+#include "../mipsasm.c"
+
+/* detectType() and getRegisterNum() as they were before the hash tables */
+static const char *r_instructions[] = {"add", "sub", "and", "or", "nor"};
+static int r_funct[] = {0x20, 0x22, 0x24, 0x25, 0x27};
+static const char *r_shift_instructions[] = {"sll", "srl", "sra"};
+static int r_shift_funct[] = {0x00, 0x02, 0x03};
+static const char *i_instructions[] = {"addi", "andi", "ori", "lw", "sw", "beq", "bne"};
+static int i_opcodes[] = {0x08, 0x0c, 0x0d, 0x23, 0x2b, 0x04, 0x05};
+static const char *register_names[32] = {
+	"zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+	"t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+	"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+	"t8", "t9", "k1", "k2", "gp", "sp", "fp", "ra"};
+
+static int classify_linear(const char *token)
+{
+	for (int i = 0; i < 5; i++)
+		if (strcmp(token, r_instructions[i]) == 0)
+			return r_funct[i];
+	for (int i = 0; i < 3; i++)
+		if (strcmp(token, r_shift_instructions[i]) == 0)
+			return r_shift_funct[i];
+	for (int i = 0; i < 7; i++)
+		if (strcmp(token, i_instructions[i]) == 0)
+			return i_opcodes[i];
+	return -1;
+}
+
+static int classify_hash(const char *token)
+{
+	Token view = {token, (int)strlen(token)};
+	const InstructionInfo *info = detectType(&view);
+
+	/* The opcode of an I-format, or the funct of an R-format */
+	return info ? (int)(info->base >> 26 | (info->base & 0x3f)) : -1;
+}
+
+static int register_linear(const char *token)
+{
+	for (int i = 0; i < 32; i++)
+		if (strcmp(token, register_names[i]) == 0)
+			return i;
+	return -1;
+}
+
+static int register_hash(const char *token)
+{
+	Token view = {token, (int)strlen(token)};
+
+	return getRegisterNum(&view);
+}
+
+#define ITERS 2000000
+
+static double run(int (*lookup)(const char *), const char *token)
+{
+	uint64_t start = now_ns();
+	uint64_t acc = 0;
+
+	for (int i = 0; i < ITERS; i++)
+		acc += lookup(token);
+	consume(acc);
+	return (double)(now_ns() - start) / ITERS;
+}
+
+/*
+ * Tokens are copied into a writable buffer, as they are after
+ * parse_command(), so the compiler cannot fold lookups of string literals.
+ */
+static int compare(const char *title, const char *const names[], int nr_names,
+				   int (*linear)(const char *), int (*hash)(const char *), bool timed)
+{
+	double total_linear = 0, total_hash = 0;
+	char token[32];
+
+	if (timed)
+		printf("%-8s %12s %12s\n", title, "linear ns", "hash ns");
+	for (int i = 0; i < nr_names; i++)
+	{
+		double t_linear, t_hash;
+
+		strcpy(token, names[i]);
+		if (linear(token) != hash(token))
+		{
+			fprintf(stderr, "mismatch on %s\n", token);
+			return -1;
+		}
+		if (!timed)
+			continue;
+		t_linear = run(linear, token);
+		t_hash = run(hash, token);
+		total_linear += t_linear;
+		total_hash += t_hash;
+		printf("%-8s %12.2f %12.2f\n", token, t_linear, t_hash);
+	}
+	if (timed)
+		printf("%-8s %12.2f %12.2f\n\n", "mean", total_linear / nr_names, total_hash / nr_names);
+	return 0;
+}
+
+static const char *const mnemonic_mix[] = {
+	"add", "sub", "and", "or", "nor", "sll", "srl", "sra",
+	"addi", "andi", "ori", "lw", "sw", "beq", "bne", "addiu",
+};
+
+static const char *const register_mix[] = {
+	"zero", "at", "v0", "a0", "t0", "t7", "s0", "s7",
+	"t8", "k1", "gp", "sp", "fp", "ra", "x9", "zeros",
+};
+
+/* Every entry of the tables must be found where it was put */
+#define ISA_ENTRY(a, b, c, d, opcode, funct, ...) {{a, b, c, d, 0}, (uint32_t)(opcode) << 26 | (funct)},
+#define REGISTER_ENTRY(a, b, c, d, num) {{a, b, c, d, 0}, num},
+
+static const struct
+{
+	char name[5];
+	uint32_t value;
+} isa[] = {MIPS_ISA(ISA_ENTRY)}, register_table[] = {MIPS_REGISTERS(REGISTER_ENTRY)};
+
+static int check_tables(void)
+{
+	for (size_t i = 0; i < sizeof(isa) / sizeof(isa[0]); i++)
+	{
+		Token view = {isa[i].name, (int)strlen(isa[i].name)};
+		const InstructionInfo *info = detectType(&view);
+
+		if (!info || info->base != isa[i].value)
+		{
+			fprintf(stderr, "mnemonic %s is not found\n", isa[i].name);
+			return -1;
+		}
+	}
+	for (size_t i = 0; i < sizeof(register_table) / sizeof(register_table[0]); i++)
+	{
+		Token view = {register_table[i].name, (int)strlen(register_table[i].name)};
+
+		if (getRegisterNum(&view) != (int)register_table[i].value)
+		{
+			fprintf(stderr, "register %s is not found\n", register_table[i].name);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Tokens with a NUL in them name nothing, even the ones that pack to 0 */
+static const Token nul_tokens[] = {{"\0", 1}, {"\0\0\0\0", 4}, {"t0\0", 3}, {"or\0", 3}, {"s\0" "0", 3}};
+
+static int check_nul(void)
+{
+	for (size_t i = 0; i < sizeof(nul_tokens) / sizeof(nul_tokens[0]); i++)
+	{
+		if (detectType(&nul_tokens[i]) || getRegisterNum(&nul_tokens[i]) >= 0)
+		{
+			fprintf(stderr, "token %zu with a NUL names something\n", i);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	bool timed = !(argc == 2 && strcmp(argv[1], "-c") == 0);
+
+	if (check_tables() || check_nul() ||
+		compare("mnemonic", mnemonic_mix, 16, classify_linear, classify_hash, timed) ||
+		compare("register", register_mix, 16, register_linear, register_hash, timed))
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
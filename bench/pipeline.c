@@ -0,0 +1,141 @@
+/**********************************************************************
+ * Whole-pipeline throughput of pa1 over a corpus, reported as JSON
+ *
+ *   bench/pipeline [-r RUNS] [-p PA1] CORPUS [-- PA1 OPTIONS...]
+ *
+ * pa1 runs RUNS times (default 5) as "PA1 OPTIONS... -o /dev/null CORPUS";
+ * the median wall time gives lines/sec, ns/line and MB/s of input.
+ **********************************************************************/
+#include "bench.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define MAX_RUNS 100
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static long count_lines(const char *path, size_t *bytes)
+{
+	struct stat st;
+	const char *map;
+	long lines = 0;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) < 0)
+		return -1;
+	*bytes = st.st_size;
+	if (st.st_size == 0)
+		return 0;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+	for (const char *p = map; (p = memchr(p, '\n', map + st.st_size - p)); p++)
+		lines++;
+	if (map[st.st_size - 1] != '\n')
+		lines++;
+	munmap((void *)map, st.st_size);
+	return lines;
+}
+
+static int run_once(char **args, uint64_t *ns)
+{
+	uint64_t start = now_ns();
+	pid_t pid = fork();
+	int status;
+
+	if (pid < 0)
+		return -1;
+	if (pid == 0)
+	{
+		execv(args[0], args);
+		_exit(127);
+	}
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return -1;
+	*ns = now_ns() - start;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *pa1 = "./pa1";
+	uint64_t times[MAX_RUNS];
+	char **args;
+	int runs = 5, nr_args = 0, opt;
+	const char *corpus;
+	size_t bytes;
+	long lines;
+	double median;
+
+	while ((opt = getopt(argc, argv, "r:p:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'r':
+			runs = atoi(optarg);
+			break;
+		case 'p':
+			pa1 = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind >= argc || runs < 1 || runs > MAX_RUNS)
+		goto usage;
+	corpus = argv[optind++];
+
+	lines = count_lines(corpus, &bytes);
+	if (lines < 0)
+	{
+		perror(corpus);
+		return EXIT_FAILURE;
+	}
+
+	/* pa1, the options after --, -o /dev/null, the corpus and NULL */
+	args = calloc(argc + 5, sizeof(*args));
+	args[nr_args++] = (char *)pa1;
+	for (int i = optind; i < argc; i++)
+		args[nr_args++] = argv[i];
+	args[nr_args++] = "-o";
+	args[nr_args++] = "/dev/null";
+	args[nr_args++] = (char *)corpus;
+
+	for (int i = 0; i < runs; i++)
+	{
+		if (run_once(args, &times[i]) < 0)
+		{
+			fprintf(stderr, "%s failed on %s\n", pa1, corpus);
+			return EXIT_FAILURE;
+		}
+	}
+	qsort(times, runs, sizeof(times[0]), compare_u64);
+	median = (double)times[runs / 2] / 1e9;
+
+	printf("{\"corpus\": \"%s\", \"lines\": %ld, \"bytes\": %zu, \"runs\": %d, "
+		   "\"min_s\": %.6f, \"median_s\": %.6f, \"max_s\": %.6f, "
+		   "\"lines_per_sec\": %.0f, \"ns_per_line\": %.2f, \"mb_per_sec\": %.2f}\n",
+		   corpus, lines, bytes, runs,
+		   (double)times[0] / 1e9, median, (double)times[runs - 1] / 1e9,
+		   lines / median, median * 1e9 / (lines ? lines : 1), bytes / median / 1e6);
+
+	free(args);
+	return EXIT_SUCCESS;
+
+usage:
+	fprintf(stderr, "Usage: %s [-r RUNS] [-p PA1] CORPUS [-- PA1 OPTIONS...]\n", argv[0]);
+	return EXIT_FAILURE;
+}
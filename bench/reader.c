@@ -0,0 +1,122 @@
+/**********************************************************************
+ * Lines/sec of reader_next() against the fgets() loop it replaced
+ *
+ *   bench/reader [-r RUNS] CORPUS
+ *   make bench-reader
+ *
+ * Both read CORPUS from the start RUNS times (default 5) and the best run
+ * counts. Each line is only measured, not translated. fgets() into the
+ * former MAX_ASSEMBLY buffer also reports how many lines it cut in two;
+ * rates are per source line for both.
+ **********************************************************************/
+#include "bench.h"
+
+#include "../mipsasm.c"
+
+#define main pa1_main
+#include "../pa1.c"
+#undef main
+
+struct result
+{
+	uint64_t ns;
+	uint64_t lines;
+	uint64_t bytes;
+};
+
+static int read_fgets(const char *path, struct result *result)
+{
+	char assembly[MAX_ASSEMBLY];
+	FILE *input = fopen(path, "r");
+
+	if (!input)
+		return -1;
+	while (fgets(assembly, sizeof(assembly), input))
+	{
+		result->lines++;
+		result->bytes += strlen(assembly);
+	}
+	fclose(input);
+	return 0;
+}
+
+static int read_reader(const char *path, struct result *result)
+{
+	struct reader reader = {.cap = READER_BUFFER_SIZE};
+	const char *line;
+	size_t len;
+	int ret;
+
+	reader.fd = open(path, O_RDONLY);
+	reader.buf = malloc(reader.cap);
+	if (reader.fd < 0 || !reader.buf)
+		return -1;
+	while ((ret = reader_next(&reader, &line, &len)) > 0)
+	{
+		result->lines++;
+		result->bytes += len + 1;
+	}
+	close(reader.fd);
+	free(reader.buf);
+	return ret;
+}
+
+static int run(int (*read_all)(const char *, struct result *), const char *path, int runs,
+			   struct result *best)
+{
+	best->ns = UINT64_MAX;
+	for (int r = 0; r < runs; r++)
+	{
+		struct result result = {0};
+		uint64_t start = now_ns();
+
+		if (read_all(path, &result) < 0)
+			return -1;
+		result.ns = now_ns() - start;
+		if (result.ns < best->ns)
+			*best = result;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct result fgets_result, reader_result;
+	int runs = 5, opt;
+
+	while ((opt = getopt(argc, argv, "r:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'r':
+			runs = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || runs < 1)
+		goto usage;
+
+	if (run(read_fgets, argv[optind], runs, &fgets_result) < 0 ||
+		run(read_reader, argv[optind], runs, &reader_result) < 0)
+	{
+		fprintf(stderr, "cannot read %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%-8s %12s %12s %10s\n", "reader", "lines", "lines/sec", "ns/line");
+	printf("%-8s %12" PRIu64 " %12.0f %10.2f\n", "fgets", fgets_result.lines,
+		   reader_result.lines / (fgets_result.ns / 1e9), (double)fgets_result.ns / reader_result.lines);
+	printf("%-8s %12" PRIu64 " %12.0f %10.2f\n", "reader", reader_result.lines,
+		   reader_result.lines / (reader_result.ns / 1e9), (double)reader_result.ns / reader_result.lines);
+	if (fgets_result.lines != reader_result.lines)
+		printf("fgets cut %" PRIu64 " lines longer than %d bytes\n",
+			   fgets_result.lines - reader_result.lines, MAX_ASSEMBLY - 1);
+
+	return EXIT_SUCCESS;
+
+usage:
+	fprintf(stderr, "Usage: %s [-r RUNS] CORPUS\n", argv[0]);
+	return EXIT_FAILURE;
+}
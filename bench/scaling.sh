@@ -0,0 +1,28 @@
+#!/bin/bash
+#
+# Wall time of pa1 -j 1..N over a corpus
+#
+#   bench/scaling.sh CORPUS [MAX_THREADS]
+#
+# MAX_THREADS defaults to the number of online CPUs. make bench-scaling
+# generates the corpus with bench/gencorpus.
+
+set -e
+
+INPUT=$1
+MAX_THREADS=${2:-$(getconf _NPROCESSORS_ONLN)}
+PA1=${PA1:-./pa1}
+
+if [ ! -f "$INPUT" ]; then
+	echo "Usage: $0 CORPUS [MAX_THREADS]" >&2
+	exit 1
+fi
+
+TIMEFORMAT=%R
+base=
+printf "%8s %10s %8s\n" threads seconds speedup
+for ((j = 1; j <= MAX_THREADS; j = j < 4 ? j + 1 : j * 2)); do
+	t=$( { time "$PA1" -j "$j" -o /dev/null "$INPUT" > /dev/null; } 2>&1 )
+	base=${base:-$t}
+	awk -v j="$j" -v t="$t" -v b="$base" 'BEGIN { printf "%8d %10.3f %8.2f\n", j, t, b / t }'
+done
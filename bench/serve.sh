@@ -0,0 +1,48 @@
+#!/bin/bash
+#
+# Wall time of many small translations: one pa1 process per file, one
+# pa1-client process per file, and one pa1-client for all of them, the
+# last two talking to a resident pa1 --serve
+#
+#   bench/serve.sh FILE [RUNS]
+#
+# FILE is translated RUNS times (default 1000) each way. make bench-serve
+# uses the first 100 lines of the corpus.
+
+set -e
+
+INPUT=$1
+RUNS=${2:-1000}
+PA1=${PA1:-./pa1}
+CLIENT=${CLIENT:-./pa1-client}
+SOCKET=${SOCKET:-/tmp/pa1-bench-$$.sock}
+
+if [ ! -f "$INPUT" ]; then
+	echo "Usage: $0 FILE [RUNS]" >&2
+	exit 1
+fi
+
+"$PA1" --serve "$SOCKET" &
+server=$!
+trap 'kill $server 2> /dev/null' EXIT
+while [ ! -S "$SOCKET" ]; do sleep 0.01; done
+
+TIMEFORMAT=%R
+printf "%-8s %10s %12s\n" mode seconds us/file
+files=()
+for ((i = 0; i < RUNS; i++)); do files+=("$INPUT"); done
+
+for mode in process client batch; do
+	t=$( { time if [ $mode = batch ]; then
+		"$CLIENT" "$SOCKET" "${files[@]}" > /dev/null
+	else
+		for ((i = 0; i < RUNS; i++)); do
+			if [ $mode = process ]; then
+				"$PA1" -o /dev/null "$INPUT" > /dev/null
+			else
+				"$CLIENT" "$SOCKET" "$INPUT" > /dev/null
+			fi
+		done
+	fi; } 2>&1 )
+	awk -v m=$mode -v t="$t" -v n="$RUNS" 'BEGIN { printf "%-8s %10.3f %12.1f\n", m, t, t * 1e6 / n }'
+done
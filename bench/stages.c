@@ -0,0 +1,232 @@
+/**********************************************************************
+ * Per-stage cost of the translation pipeline over a warm corpus
+ *
+ *   bench/stages [-n LINES] [-p PASSES] CORPUS
+ *   make bench-stages
+ *
+ * The first LINES lines of the corpus (default 64K, which keeps the working
+ * set in cache) are split out, and every stage's inputs are prepared
+ * up front by running the pipeline once, so each stage is timed on its
+ * own. Each stage runs over the lines in batches of BATCH lines; the
+ * per-line time of every batch across all passes is one sample, and
+ * min/median/p99 are taken over those samples.
+ **********************************************************************/
+#include "bench.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../mipsasm.c"
+
+#define main pa1_main
+#include "../pa1.c"
+#undef main
+
+#define BATCH 1024
+
+/* translate() only looks at the first four tokens, so only those are kept */
+struct line
+{
+	const char *str;
+	size_t len;
+	Token tokens[4];
+	int nr_tokens;
+	const InstructionInfo *info;
+	uint32_t word;
+};
+
+/*
+ * Each stage is a loop over one batch of lines with the work inlined, so
+ * no stage pays for an indirect call per line.
+ */
+#define STAGE(name, body)                                        \
+	static uint64_t stage_##name(struct line *lines, size_t nr) \
+	{                                                            \
+		uint64_t acc = 0;                                        \
+		for (size_t i = 0; i < nr; i++)                          \
+		{                                                        \
+			struct line *l = &lines[i];                          \
+			body;                                                \
+		}                                                        \
+		return acc;                                              \
+	}
+
+STAGE(tokenize, {
+	Token tokens[MAX_NR_TOKENS];
+	int nr_tokens;
+
+	parse_command(l->str, l->len, &nr_tokens, tokens);
+	acc += nr_tokens + tokens[0].len;
+})
+
+/* What is left of case folding: packing and folding the lookup keys */
+STAGE(casefold, {
+	for (int t = 0; t < 4; t++)
+		acc += pack_token(&l->tokens[t]);
+})
+
+STAGE(classify, {
+	acc += detectType(&l->tokens[0])->base;
+})
+
+STAGE(registers, {
+	for (int i = 0; i < 3; i++)
+		if (fields[l->info->operands[i]].is_register)
+			acc += getRegisterNum(&l->tokens[i + 1]);
+})
+
+STAGE(immediate, {
+	for (int i = 0; i < 3; i++)
+	{
+		int value = 0;
+
+		if (!fields[l->info->operands[i]].is_register)
+			acc += getImmediate(&l->tokens[i + 1], &value) + value;
+	}
+})
+
+STAGE(translate, {
+	uint32_t word;
+
+	acc += translate(l->nr_tokens, l->tokens, &word) + word;
+})
+
+STAGE(format, {
+	char buf[WORD_TEXT_LEN];
+
+	format_word(buf, l->word);
+	acc += buf[9];
+})
+
+static const struct
+{
+	const char *name;
+	uint64_t (*run)(struct line *lines, size_t nr);
+} stages[] = {
+	{"tokenize", stage_tokenize},
+	{"casefold", stage_casefold},
+	{"classify", stage_classify},
+	{"registers", stage_registers},
+	{"immediate", stage_immediate},
+	{"translate", stage_translate},
+	{"format", stage_format},
+};
+#define NR_STAGES (sizeof(stages) / sizeof(stages[0]))
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Split @path into lines that the pipeline translates, at most @max of them */
+static size_t load_lines(const char *path, struct line **lines, size_t max)
+{
+	struct stat st;
+	const char *map, *curr, *end;
+	size_t nr = 0;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0)
+		return 0;
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+
+	*lines = calloc(max, sizeof(**lines));
+	for (curr = map, end = map + st.st_size; curr < end && nr < max;)
+	{
+		const char *eol = memchr(curr, '\n', end - curr);
+		struct line *l = &(*lines)[nr];
+		Token tokens[MAX_NR_TOKENS];
+
+		if (!eol)
+			eol = end;
+		l->str = curr;
+		l->len = eol - curr;
+		curr = eol + 1;
+
+		parse_command(l->str, l->len, &l->nr_tokens, tokens);
+		if (l->nr_tokens < 4)
+			continue;
+		l->nr_tokens = 4;
+		memcpy(l->tokens, tokens, sizeof(l->tokens));
+		l->info = detectType(&l->tokens[0]);
+		if (!l->info)
+			continue;
+		translate(l->nr_tokens, l->tokens, &l->word);
+		nr++;
+	}
+	return nr;
+}
+
+int main(int argc, char *argv[])
+{
+	struct line *lines;
+	size_t max_lines = 65536, nr_lines, nr_batches;
+	int passes = 20, opt;
+	double *samples;
+
+	while ((opt = getopt(argc, argv, "n:p:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			max_lines = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			passes = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || max_lines == 0 || passes < 1)
+		goto usage;
+
+	nr_lines = load_lines(argv[optind], &lines, max_lines);
+	if (nr_lines == 0)
+	{
+		fprintf(stderr, "no translatable lines in %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	nr_batches = (nr_lines + BATCH - 1) / BATCH;
+	samples = malloc(nr_batches * passes * sizeof(*samples));
+
+	printf("%zu lines, %d passes, %d lines per sample\n", nr_lines, passes, BATCH);
+	printf("%-10s %10s %10s %10s\n", "stage", "min ns", "median ns", "p99 ns");
+	for (size_t s = 0; s < NR_STAGES; s++)
+	{
+		size_t nr_samples = 0;
+
+		/* One untimed pass to warm caches and branch predictors */
+		consume(stages[s].run(lines, nr_lines));
+
+		for (int p = 0; p < passes; p++)
+		{
+			for (size_t b = 0; b < nr_lines; b += BATCH)
+			{
+				size_t nr = nr_lines - b < BATCH ? nr_lines - b : BATCH;
+				uint64_t start = now_ns();
+
+				consume(stages[s].run(lines + b, nr));
+				samples[nr_samples++] = (double)(now_ns() - start) / nr;
+			}
+		}
+
+		qsort(samples, nr_samples, sizeof(*samples), compare_double);
+		printf("%-10s %10.2f %10.2f %10.2f\n", stages[s].name, samples[0],
+			   samples[nr_samples / 2], samples[nr_samples * 99 / 100]);
+	}
+
+	free(samples);
+	free(lines);
+	return EXIT_SUCCESS;
+
+usage:
+	fprintf(stderr, "Usage: %s [-n LINES] [-p PASSES] CORPUS\n", argv[0]);
+	return EXIT_FAILURE;
+}
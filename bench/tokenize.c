@@ -0,0 +1,138 @@
+/**********************************************************************
+ * ns/line of parse_command() against the former byte-at-a-time loop
+ *
+ *   make bench-tokenize
+ *   make bench-tokenize BENCH_CFLAGS="-O2 -mavx2"   (32-byte blocks)
+ **********************************************************************/
+#include "bench.h"
+
+#include <stdlib.h>
+
+#include "../mipsasm.c"
+
+/* parse_command() as it was before the block classifier */
+static int parse_command_scalar(const char *assembly, size_t len, int *nr_tokens, Token tokens[])
+{
+	const char *curr = assembly;
+	const char *end = assembly + len;
+	int token_started = false;
+	*nr_tokens = 0;
+
+	while (curr < end)
+	{
+		if (isspace(*curr))
+		{
+			token_started = false;
+		}
+		else if (token_started)
+		{
+			tokens[*nr_tokens - 1].len++;
+		}
+		else if (*nr_tokens < MAX_NR_TOKENS)
+		{
+			tokens[*nr_tokens].str = curr;
+			tokens[*nr_tokens].len = 1;
+			*nr_tokens += 1;
+			token_started = true;
+		}
+		curr++;
+	}
+	return 0;
+}
+
+static const char *const corpus[] = {
+	"add t0 t1 t2",
+	"addi sp sp -0x10",
+	"  sll   s2\ts2 0x1d  ",
+	"lw s0 0x7ee8 s1",
+	"beq zero at 0x2eef",
+	"sw s4 -0x0072 s1    /* spill s4 */",
+	"ori k1 a2 -0x4bad   /* generated by the register allocator, see pass 7 */",
+	"",
+};
+#define NR_CORPUS (sizeof(corpus) / sizeof(corpus[0]))
+#define ITERS 2000000
+
+static int same_tokens(const char *line, size_t len)
+{
+	Token a[MAX_NR_TOKENS], b[MAX_NR_TOKENS];
+	int nr_a, nr_b;
+
+	parse_command_scalar(line, len, &nr_a, a);
+	parse_command(line, len, &nr_b, b);
+	if (nr_a != nr_b)
+		return 0;
+	for (int i = 0; i < nr_a; i++)
+		if (a[i].str != b[i].str || a[i].len != b[i].len)
+			return 0;
+	return 1;
+}
+
+/* Random lines over a small alphabet heavy in whitespace, all lengths */
+static int fuzz(void)
+{
+	static const char alphabet[] = " \t\n\v\f\rax0-";
+	char line[200];
+
+	srand(1);
+	for (int i = 0; i < 200000; i++)
+	{
+		size_t len = rand() % sizeof(line);
+
+		for (size_t j = 0; j < len; j++)
+			line[j] = alphabet[rand() % (sizeof(alphabet) - 1)];
+		if (!same_tokens(line, len))
+		{
+			fprintf(stderr, "mismatch on a %zu-byte line\n", len);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static double run(int (*parse)(const char *, size_t, int *, Token *), const char *line, size_t len)
+{
+	Token tokens[MAX_NR_TOKENS];
+	uint64_t start = now_ns();
+	uint64_t acc = 0;
+	int nr_tokens;
+
+	for (int i = 0; i < ITERS; i++)
+	{
+		parse(line, len, &nr_tokens, tokens);
+		acc += nr_tokens + (nr_tokens ? tokens[0].len : 0);
+	}
+	consume(acc);
+	return (double)(now_ns() - start) / ITERS;
+}
+
+int main(void)
+{
+	double total_scalar = 0, total_block = 0;
+	char line[128];
+
+	if (fuzz() < 0)
+		return EXIT_FAILURE;
+
+#ifdef WS_BLOCK
+	printf("block size %d bytes\n", WS_BLOCK);
+#else
+	printf("no SIMD; both columns run the scalar loop\n");
+#endif
+	printf("%-6s %12s %12s\n", "bytes", "scalar ns", "block ns");
+	for (size_t i = 0; i < NR_CORPUS; i++)
+	{
+		size_t len = strlen(corpus[i]);
+		double scalar, block;
+
+		memcpy(line, corpus[i], len);
+		scalar = run(parse_command_scalar, line, len);
+		block = run(parse_command, line, len);
+		total_scalar += scalar;
+		total_block += block;
+		printf("%-6zu %12.2f %12.2f\n", len, scalar, block);
+	}
+	printf("%-6s %12.2f %12.2f\n", "mean", total_scalar / NR_CORPUS, total_block / NR_CORPUS);
+
+	return EXIT_SUCCESS;
+}
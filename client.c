@@ -0,0 +1,230 @@
+/**********************************************************************
+ * Copyright (c) 2021-2023
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/***********************************************************************
+ * pa1-client: translate files with a running pa1 --serve
+ *
+ *   pa1-client SOCKET [FILE...]
+ *
+ * Each FILE, or stdin, is sent in requests of whole lines,
+ * SERVE_MAX_REQUEST bytes at most, all over one connection. The words go
+ * to stdout as "0x%08x\n", as pa1 -o writes them, one file after the
+ * other; lines that do not translate are reported on stderr as FILE:LINE
+ * and produce 0. The exit status is 1 if any line failed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "mipsasm.h"
+#include "serve.h"
+
+static int read_all(int fd, char **buf, size_t *len)
+{
+	size_t cap = 1 << 16;
+
+	*len = 0;
+	if (!(*buf = malloc(cap)))
+		return -1;
+	for (;;)
+	{
+		ssize_t ret;
+
+		if (*len == cap)
+		{
+			char *grown = realloc(*buf, cap * 2);
+
+			if (!grown)
+				return -1;
+			*buf = grown;
+			cap *= 2;
+		}
+		ret = read(fd, *buf + *len, cap - *len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return ret;
+		*len += ret;
+	}
+}
+
+static int send_all(int fd, const void *buf, size_t len)
+{
+	const char *curr = buf;
+
+	while (len > 0)
+	{
+		ssize_t ret = send(fd, curr, len, MSG_NOSIGNAL);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return -1;
+		curr += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static int recv_all(int fd, void *buf, size_t len)
+{
+	char *curr = buf;
+
+	while (len > 0)
+	{
+		ssize_t ret = recv(fd, curr, len, 0);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		curr += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+/*
+ * Send one request of @len bytes at @lines of @name and print its
+ * response; line numbers continue from *@line_no. Return the number of
+ * failed lines, or -1 if the server could not be talked to.
+ */
+static long translate(int fd, const char *name, const char *lines, size_t len, unsigned long *line_no)
+{
+	unsigned char header[SERVE_HEADER_LEN];
+	unsigned char *resp;
+	uint32_t nr_lines;
+	long failed = 0;
+
+	put_be32(header, len);
+	if (send_all(fd, header, sizeof(header)) < 0 || send_all(fd, lines, len) < 0 ||
+		recv_all(fd, header, sizeof(header)) < 0)
+		return -1;
+
+	nr_lines = get_be32(header);
+	if (!(resp = malloc((size_t)nr_lines * 5 + 1)) || recv_all(fd, resp, (size_t)nr_lines * 5) < 0)
+	{
+		free(resp);
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < nr_lines; i++)
+	{
+		int status = resp[(size_t)nr_lines * 4 + i];
+
+		++*line_no;
+		if (status == MIPSASM_BLANK)
+			continue;
+		if (status != MIPSASM_OK)
+		{
+			fprintf(stderr, "%s:%lu: %s\n", name, *line_no, mipsasm_strerror(status));
+			failed++;
+		}
+		printf("0x%08x\n", get_be32(resp + 4 * i));
+	}
+	free(resp);
+	return failed;
+}
+
+/* Translate all of @input; return the number of failed lines, or -1 */
+static long translate_file(int fd, const char *name, int input)
+{
+	unsigned long line_no = 0;
+	size_t len, offset = 0;
+	long failed = 0;
+	char *buf;
+
+	if (read_all(input, &buf, &len) < 0)
+	{
+		fprintf(stderr, "Cannot read %s: %s\n", name, strerror(errno));
+		free(buf);
+		return -1;
+	}
+
+	/* Cut requests after the last newline that keeps them in bounds */
+	while (offset < len)
+	{
+		size_t size = len - offset;
+		long ret;
+
+		if (size > SERVE_MAX_REQUEST)
+		{
+			size = SERVE_MAX_REQUEST;
+			while (size > 1 && buf[offset + size - 1] != '\n')
+				size--;
+			if (buf[offset + size - 1] != '\n')
+				size = SERVE_MAX_REQUEST; // a single line that long is cut anyway
+		}
+		if ((ret = translate(fd, name, buf + offset, size, &line_no)) < 0)
+		{
+			fprintf(stderr, "Lost connection to the server\n");
+			failed = -1;
+			break;
+		}
+		failed += ret;
+		offset += size;
+	}
+
+	free(buf);
+	return failed;
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	long failed = 0;
+	int fd;
+
+	if (argc < 2 || strlen(argv[1]) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Usage: %s SOCKET [FILE...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	strcpy(addr.sun_path, argv[1]);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		fprintf(stderr, "Cannot connect to %s: %s\n", argv[1], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (argc == 2)
+		failed = translate_file(fd, "<stdin>", STDIN_FILENO);
+	for (int i = 2; i < argc && failed >= 0; i++)
+	{
+		int input = open(argv[i], O_RDONLY);
+		long ret;
+
+		if (input < 0)
+		{
+			fprintf(stderr, "No input file %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+		ret = translate_file(fd, argv[i], input);
+		close(input);
+		failed = ret < 0 ? ret : failed + ret;
+	}
+
+	close(fd);
+	if (fflush(stdout) != 0 || failed < 0)
+		return EXIT_FAILURE;
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,823 @@
+/**********************************************************************
+ * Copyright (c) 2021-2023
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "mipsasm.h"
+#include "whitespace.h"
+
+#define MAX_NR_TOKENS 16 /* Maximum length of tokens in a command */
+
+typedef unsigned char bool;
+#define true 1
+#define false 0
+
+/***********************************************************************
+ * translate()
+ *
+ * DESCRIPTION
+ *   Translate assembly represented in @tokens[] into a MIPS instruction.
+ *   This translate should support following 13 assembly commands
+ *
+ *    - add
+ *    - addi
+ *    - sub
+ *    - and
+ *    - andi
+ *    - or
+ *    - ori
+ *    - nor
+ *    - lw
+ *    - sw
+ *    - sll
+ *    - srl
+ *    - sra
+ *    - beq
+ *    - bne
+ *
+ * RETURN VALUE
+ *   Return MIPSASM_OK after storing the 32-bit MIPS instruction to @word,
+ *   or the MIPSASM_ERR_* status that describes what is wrong with @tokens[]
+ *
+ */
+
+/* A token is a view into the line it was parsed from; it is not NUL-terminated */
+typedef struct
+{
+	const char *str;
+	int len;
+} Token;
+
+/*
+ * The instruction set, one line per instruction: the mnemonic, the opcode
+ * and funct bits, and the field each of tokens[1..3] is encoded into. The
+ * mnemonic table and the encoder are both generated from this list, so an
+ * instruction is added here and nowhere else.
+ */
+#define MIPS_ISA(X)                                      \
+	/* R-format */                                       \
+	X('a', 'd', 'd', 0, 0x00, 0x20, RD, RS, RT)          \
+	X('s', 'u', 'b', 0, 0x00, 0x22, RD, RS, RT)          \
+	X('a', 'n', 'd', 0, 0x00, 0x24, RD, RS, RT)          \
+	X('o', 'r', 0, 0, 0x00, 0x25, RD, RS, RT)            \
+	X('n', 'o', 'r', 0, 0x00, 0x27, RD, RS, RT)          \
+	/* R-Shift */                                        \
+	X('s', 'l', 'l', 0, 0x00, 0x00, RD, RT, SHAMT)       \
+	X('s', 'r', 'l', 0, 0x00, 0x02, RD, RT, SHAMT)       \
+	X('s', 'r', 'a', 0, 0x00, 0x03, RD, RT, SHAMT)       \
+	/* I-format */                                       \
+	X('a', 'd', 'd', 'i', 0x08, 0x00, RT, RS, IMM)       \
+	X('a', 'n', 'd', 'i', 0x0c, 0x00, RT, RS, IMM)       \
+	X('o', 'r', 'i', 0, 0x0d, 0x00, RT, RS, IMM)         \
+	X('l', 'w', 0, 0, 0x23, 0x00, RT, IMM, RS)           \
+	X('s', 'w', 0, 0, 0x2b, 0x00, RT, IMM, RS)           \
+	X('b', 'e', 'q', 0, 0x04, 0x00, RT, RS, IMM)         \
+	X('b', 'n', 'e', 0, 0x05, 0x00, RT, RS, IMM)
+
+/* Instruction fields an operand token can be encoded into */
+enum
+{
+	FIELD_RS,
+	FIELD_RT,
+	FIELD_RD,
+	FIELD_SHAMT,
+	FIELD_IMM,
+	NR_FIELDS,
+};
+
+typedef struct
+{
+	bool is_register; /* a register name, or else a number */
+	uint8_t shift;	  /* position of the field in the word */
+	uint32_t mask;	  /* width of the field */
+	int min, max;	  /* accepted range of numbers */
+} Field;
+
+static const Field fields[] = {
+	[FIELD_RS] = {true, 21, 0x1f, 0, 31},
+	[FIELD_RT] = {true, 16, 0x1f, 0, 31},
+	[FIELD_RD] = {true, 11, 0x1f, 0, 31},
+	[FIELD_SHAMT] = {false, 6, 0x1f, 0, 31},
+	/* 16 bits, read as signed or unsigned (andi/ori zero-extend) */
+	[FIELD_IMM] = {false, 0, 0xffff, -0x8000, 0xffff},
+};
+
+typedef struct
+{
+	uint32_t base;		 /* opcode and funct, with every operand field 0 */
+	uint8_t operands[3]; /* FIELD_* of tokens[1..3] */
+} InstructionInfo;
+
+/*
+ * Mnemonics and register names are at most 4 characters, so each one packs
+ * into a 32-bit key. The tables below are indexed by the top bits of the
+ * key times a multiplier picked so that the slots are collision-free. One
+ * probe and one key compare classify a token.
+ */
+#define TOKEN_KEY(a, b, c, d) \
+	((unsigned int)(a) | (unsigned int)(b) << 8 | (unsigned int)(c) << 16 | (unsigned int)(d) << 24)
+
+/*
+ * Fold 'A'..'Z' to lowercase in all four bytes of a key at once. A byte is
+ * uppercase if adding 0x3f carries into its top bit but adding 0x25 does
+ * not; bytes with the top bit already set are left alone. Folding here is
+ * what lets the input go through without a separate lowercase pass.
+ */
+static inline unsigned int fold_key(unsigned int key)
+{
+	unsigned int low7 = key & 0x7f7f7f7fu;
+	unsigned int ge_a = low7 + 0x3f3f3f3fu;
+	unsigned int gt_z = low7 + 0x25252525u;
+
+	return key | ((ge_a & ~gt_z & ~key & 0x80808080u) >> 2);
+}
+
+/*
+ * Tokens longer than 4 characters get a key that no table entry has, and
+ * so do tokens with a NUL in them: their key would read as a shorter name,
+ * or as 0, the key of the empty slots.
+ */
+static inline unsigned int pack_token(const Token *token)
+{
+	unsigned int key = 0;
+
+	if (token->len > 4)
+		return ~0u;
+
+	for (int i = 0; i < token->len; i++)
+	{
+		unsigned char c = token->str[i];
+
+		if (!c)
+			return ~0u;
+		key |= (unsigned int)c << (8 * i);
+	}
+	return fold_key(key);
+}
+
+#define MNEMONIC_SLOT(key) ((unsigned int)((key) * 0x9e3779b1u) >> 27)
+
+typedef struct
+{
+	unsigned int key;
+	InstructionInfo info;
+} MnemonicEntry;
+
+#define MNEMONIC(a, b, c, d, opcode, funct, op1, op2, op3) \
+	[MNEMONIC_SLOT(TOKEN_KEY(a, b, c, d))] = {           \
+		TOKEN_KEY(a, b, c, d),                           \
+		{(uint32_t)(opcode) << 26 | (funct), {FIELD_##op1, FIELD_##op2, FIELD_##op3}}},
+
+static const MnemonicEntry mnemonics[32] = {MIPS_ISA(MNEMONIC)};
+
+/*
+ * A second entry for a slot would silently replace the first, so the slots
+ * are checked at compile time: the bits 1 << slot of the entries add up to
+ * their or only if no slot repeats.
+ */
+#define SLOT_BIT(slot) ((unsigned __int128)1 << (slot))
+#define MNEMONIC_SUM(a, b, c, d, ...) +SLOT_BIT(MNEMONIC_SLOT(TOKEN_KEY(a, b, c, d)))
+#define MNEMONIC_OR(a, b, c, d, ...) | SLOT_BIT(MNEMONIC_SLOT(TOKEN_KEY(a, b, c, d)))
+_Static_assert((0 MIPS_ISA(MNEMONIC_SUM)) == (0 MIPS_ISA(MNEMONIC_OR)), "two mnemonics share a slot");
+
+#define REGISTER_SLOT(key) ((unsigned int)((key) * 0x02383827u) >> 26)
+
+typedef struct
+{
+	unsigned int key;
+	int num;
+} RegisterEntry;
+
+/* Register names and numbers */
+#define MIPS_REGISTERS(X)                         \
+	X('z', 'e', 'r', 'o', 0) X('a', 't', 0, 0, 1) \
+	X('v', '0', 0, 0, 2) X('v', '1', 0, 0, 3)     \
+	X('a', '0', 0, 0, 4) X('a', '1', 0, 0, 5)     \
+	X('a', '2', 0, 0, 6) X('a', '3', 0, 0, 7)     \
+	X('t', '0', 0, 0, 8) X('t', '1', 0, 0, 9)     \
+	X('t', '2', 0, 0, 10) X('t', '3', 0, 0, 11)   \
+	X('t', '4', 0, 0, 12) X('t', '5', 0, 0, 13)   \
+	X('t', '6', 0, 0, 14) X('t', '7', 0, 0, 15)   \
+	X('s', '0', 0, 0, 16) X('s', '1', 0, 0, 17)   \
+	X('s', '2', 0, 0, 18) X('s', '3', 0, 0, 19)   \
+	X('s', '4', 0, 0, 20) X('s', '5', 0, 0, 21)   \
+	X('s', '6', 0, 0, 22) X('s', '7', 0, 0, 23)   \
+	X('t', '8', 0, 0, 24) X('t', '9', 0, 0, 25)   \
+	X('k', '1', 0, 0, 26) X('k', '2', 0, 0, 27)   \
+	X('g', 'p', 0, 0, 28) X('s', 'p', 0, 0, 29)   \
+	X('f', 'p', 0, 0, 30) X('r', 'a', 0, 0, 31)
+
+#define REGISTER(a, b, c, d, num) [REGISTER_SLOT(TOKEN_KEY(a, b, c, d))] = {TOKEN_KEY(a, b, c, d), num},
+
+static const RegisterEntry registers[64] = {MIPS_REGISTERS(REGISTER)};
+
+#define REGISTER_SUM(a, b, c, d, num) +SLOT_BIT(REGISTER_SLOT(TOKEN_KEY(a, b, c, d)))
+#define REGISTER_OR(a, b, c, d, num) | SLOT_BIT(REGISTER_SLOT(TOKEN_KEY(a, b, c, d)))
+_Static_assert((0 MIPS_REGISTERS(REGISTER_SUM)) == (0 MIPS_REGISTERS(REGISTER_OR)), "two registers share a slot");
+
+/* Return the encoding of the mnemonic @token, or NULL if it is none */
+static const InstructionInfo *detectType(const Token *token)
+{
+	unsigned int key = pack_token(token);
+	const MnemonicEntry *entry = &mnemonics[MNEMONIC_SLOT(key)];
+
+	return entry->key == key ? &entry->info : NULL;
+}
+
+/* Return the register number of @token, or -1 if it names no register */
+static int getRegisterNum(const Token *token)
+{
+	unsigned int key = pack_token(token);
+	const RegisterEntry *entry = &registers[REGISTER_SLOT(key)];
+
+	return entry->key == key ? entry->num : -1;
+}
+
+/* Digit value plus one, so that 0 marks bytes that are not digits */
+#define DIGIT(c, v) [c] = (v) + 1
+static const unsigned char digit_values[256] = {
+		DIGIT('0', 0), DIGIT('1', 1), DIGIT('2', 2), DIGIT('3', 3),
+		DIGIT('4', 4), DIGIT('5', 5), DIGIT('6', 6), DIGIT('7', 7),
+		DIGIT('8', 8), DIGIT('9', 9),
+		DIGIT('a', 10), DIGIT('b', 11), DIGIT('c', 12),
+		DIGIT('d', 13), DIGIT('e', 14), DIGIT('f', 15),
+		DIGIT('A', 10), DIGIT('B', 11), DIGIT('C', 12),
+		DIGIT('D', 13), DIGIT('E', 14), DIGIT('F', 15),
+};
+
+/* getImmediate() results */
+enum
+{
+	IMM_OK,
+	IMM_INVALID,  /* not a number in any of the accepted forms */
+	IMM_OVERFLOW, /* does not fit in an int */
+};
+
+/*
+ * Parse @token as the README defines shamt and immediate values: decimal
+ * digits, or 0x and hex digits, either one optionally after a minus (10,
+ * -22, 0x1d, -0x42). Unlike strtol() there is no octal, no locale, no
+ * errno and no trailing garbage. The value is stored to @value.
+ */
+static int getImmediate(const Token *token, int *value)
+{
+	const unsigned char *curr = (const unsigned char *)token->str;
+	const unsigned char *end = curr + token->len;
+	bool negative = *curr == '-';
+	bool overflow = false;
+	unsigned int base = 10;
+	uint64_t magnitude = 0;
+
+	curr += negative;
+	if (end - curr > 2 && curr[0] == '0' && (curr[1] | 0x20) == 'x')
+	{
+		base = 16;
+		curr += 2;
+	}
+	if (curr == end)
+		return IMM_INVALID;
+
+	for (; curr < end; curr++)
+	{
+		unsigned int digit = digit_values[*curr] - 1u; // wraps for non-digits
+
+		if (digit >= base)
+			return IMM_INVALID;
+		magnitude = magnitude * base + digit;
+		if (magnitude > 0x80000000u) // saturate; no int is bigger anyway
+		{
+			magnitude = 0x80000000u;
+			overflow = true;
+		}
+	}
+
+	if (overflow || magnitude > 0x7fffffffu + negative)
+		return IMM_OVERFLOW;
+
+	*value = negative ? (int)-(int64_t)magnitude : (int)magnitude;
+	return IMM_OK;
+}
+
+/*
+ * Encoding is split in two. decode() looks up and checks the operands of a
+ * line and leaves them, masked but not shifted, in one lane of a set of
+ * columns: one column per field plus the base word, a structure of arrays.
+ * Packing the lanes into words is then the same shifts and ors for every
+ * line, whatever its format, and runs a vector of lanes at a time.
+ */
+#define COLUMN_BASE NR_FIELDS
+#define NR_COLUMNS (NR_FIELDS + 1)
+
+/*
+ * Decode @tokens[] into the lane at @lane, whose columns are @stride words
+ * apart. Fields the instruction does not use are 0, and so is the whole
+ * lane unless MIPSASM_OK is returned. Register errors win over immediate
+ * errors, whichever operand comes first, so failures are only collected
+ * inside the operand loop.
+ */
+static int decode(int nr_tokens, Token tokens[], uint32_t *lane, size_t stride)
+{
+	const InstructionInfo *info;
+	uint32_t values[3];
+	bool bad_register = false, bad_immediate = false;
+
+	for (int c = 0; c < NR_COLUMNS; c++)
+		lane[c * stride] = 0;
+
+	if (nr_tokens < 4)
+		return MIPSASM_ERR_COMMAND;
+
+	info = detectType(&tokens[0]);
+	if (!info)
+		return MIPSASM_ERR_COMMAND;
+
+	for (int i = 0; i < 3; i++)
+	{
+		const Field *field = &fields[info->operands[i]];
+		int value = 0;
+
+		if (field->is_register)
+		{
+			value = getRegisterNum(&tokens[i + 1]);
+			bad_register |= value < 0;
+		}
+		else
+		{
+			bad_immediate |= getImmediate(&tokens[i + 1], &value) != IMM_OK ||
+							 value < field->min || value > field->max;
+		}
+		values[i] = (uint32_t)value & field->mask;
+	}
+
+	if (bad_register)
+		return MIPSASM_ERR_REGISTER;
+	if (bad_immediate)
+		return MIPSASM_ERR_IMMEDIATE;
+
+	lane[COLUMN_BASE * stride] = info->base;
+	for (int i = 0; i < 3; i++)
+		lane[info->operands[i] * stride] = values[i];
+	return MIPSASM_OK;
+}
+
+/* Pack @nr lanes of @columns into @words[], one lane at a time */
+static void pack_scalar(const uint32_t *columns, size_t stride, size_t nr, uint32_t words[])
+{
+	for (size_t i = 0; i < nr; i++)
+	{
+		uint32_t word = columns[COLUMN_BASE * stride + i];
+
+		for (int f = 0; f < NR_FIELDS; f++)
+			word |= columns[f * stride + i] << fields[f].shift;
+		words[i] = word;
+	}
+}
+
+/*
+ * pack_columns() is pack_scalar() a vector of lanes at a time, with the
+ * widest vectors the build targets; the lanes left over go through
+ * pack_scalar().
+ */
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define PACK_LANES 16
+typedef __m512i PackVector;
+#define PACK_LOAD(p) _mm512_loadu_si512((const void *)(p))
+#define PACK_STORE(p, v) _mm512_storeu_si512((void *)(p), v)
+#define PACK_SHIFT_OR(acc, v, n) _mm512_or_si512(acc, _mm512_slli_epi32(v, n))
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define PACK_LANES 8
+typedef __m256i PackVector;
+#define PACK_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define PACK_STORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define PACK_SHIFT_OR(acc, v, n) _mm256_or_si256(acc, _mm256_slli_epi32(v, n))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PACK_LANES 4
+typedef __m128i PackVector;
+#define PACK_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define PACK_STORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define PACK_SHIFT_OR(acc, v, n) _mm_or_si128(acc, _mm_slli_epi32(v, n))
+#endif
+
+#ifdef PACK_LANES
+static void pack_columns(const uint32_t *columns, size_t stride, size_t nr, uint32_t words[])
+{
+	size_t i = 0;
+
+	for (; i + PACK_LANES <= nr; i += PACK_LANES)
+	{
+		PackVector word = PACK_LOAD(columns + COLUMN_BASE * stride + i);
+
+		word = PACK_SHIFT_OR(word, PACK_LOAD(columns + FIELD_RS * stride + i), 21);
+		word = PACK_SHIFT_OR(word, PACK_LOAD(columns + FIELD_RT * stride + i), 16);
+		word = PACK_SHIFT_OR(word, PACK_LOAD(columns + FIELD_RD * stride + i), 11);
+		word = PACK_SHIFT_OR(word, PACK_LOAD(columns + FIELD_SHAMT * stride + i), 6);
+		word = PACK_SHIFT_OR(word, PACK_LOAD(columns + FIELD_IMM * stride + i), 0);
+		PACK_STORE(words + i, word);
+	}
+	pack_scalar(columns + i, stride, nr - i, words + i);
+}
+#else
+#define pack_columns pack_scalar
+#endif
+
+static int translate(int nr_tokens, Token tokens[], uint32_t *word)
+{
+	uint32_t lane[NR_COLUMNS];
+	int status = decode(nr_tokens, tokens, lane, 1);
+
+	pack_scalar(lane, 1, 1, word);
+	return status;
+}
+
+/***********************************************************************
+ * parse_command()
+ *
+ * DESCRIPTION
+ *   Parse @len bytes of @assembly, and put each assembly token into @tokens[]
+ *   and the number of tokes into @nr_tokens. Each token points into
+ *   @assembly and carries its length, so @assembly is left untouched and
+ *   need not be NUL-terminated.
+ *
+ *   A assembly token is defined as a string without any whitespace (i.e., space
+ *   and tab in this programming assignment). For exmaple,
+ *     command = "  add t1   t2 s0 "
+ *
+ *   then, nr_tokens = 4, and tokens is
+ *     tokens[0] = "add"
+ *     tokens[1] = "t0"
+ *     tokens[2] = "t1"
+ *     tokens[3] = "s0"
+ *
+ *   Tokens beyond MAX_NR_TOKENS are dropped.
+ *
+ *   The characters may be in either case; the lookups in translate() fold
+ *   case themselves.
+ *
+ *
+ * RETURN VALUE
+ *   Return 0 after filling in @nr_tokens and @tokens[] properly
+ *
+ */
+#ifdef WS_BLOCK
+/*
+ * Whitespace is classified a block at a time with whitespace_mask(). A
+ * token starts or ends wherever a bit differs from the one before it, so
+ * the tokens fall out of the edges of the inverted mask without looking
+ * at the bytes one by one.
+ */
+static int parse_command(const char *assembly, size_t len, int *nr_tokens, Token tokens[])
+{
+	char tail[WS_BLOCK] = {0};
+	uint32_t carry = 0; /* 1 if the byte before the block belongs to a token */
+	size_t start = 0;
+	*nr_tokens = 0;
+
+	for (size_t offset = 0; offset < len; offset += WS_BLOCK)
+	{
+		const char *block = assembly + offset;
+		uint32_t word, edges;
+
+		if (len - offset >= WS_BLOCK)
+		{
+			word = ~whitespace_mask(block) & WS_BLOCK_MASK;
+		}
+		else
+		{
+			/*
+			 * The rest of the line is copied out so that nothing past the
+			 * caller's buffer is read; the bytes after it are masked off.
+			 */
+			memcpy(tail, block, len - offset);
+			word = ~whitespace_mask(tail) & (((uint32_t)1 << (len - offset)) - 1);
+		}
+		edges = (word ^ ((word << 1) | carry)) & WS_BLOCK_MASK;
+		carry = word >> (WS_BLOCK - 1);
+
+		for (; edges; edges &= edges - 1)
+		{
+			size_t pos = offset + __builtin_ctz(edges);
+
+			if (!(word >> (pos - offset) & 1))
+			{
+				if (*nr_tokens < MAX_NR_TOKENS)
+				{
+					tokens[*nr_tokens].str = assembly + start;
+					tokens[*nr_tokens].len = pos - start;
+					*nr_tokens += 1;
+				}
+			}
+			else
+			{
+				start = pos;
+			}
+		}
+	}
+
+	/* Only a full last block can leave a token open */
+	if (carry && *nr_tokens < MAX_NR_TOKENS)
+	{
+		tokens[*nr_tokens].str = assembly + start;
+		tokens[*nr_tokens].len = len - start;
+		*nr_tokens += 1;
+	}
+
+	return 0;
+}
+#else
+static int parse_command(const char *assembly, size_t len, int *nr_tokens, Token tokens[])
+{
+	const char *curr = assembly;
+	const char *end = assembly + len;
+	int token_started = false;
+	*nr_tokens = 0;
+
+	while (curr < end)
+	{
+		if (isspace(*curr))
+		{
+			token_started = false;
+		}
+		else if (token_started)
+		{
+			tokens[*nr_tokens - 1].len++;
+		}
+		else if (*nr_tokens < MAX_NR_TOKENS)
+		{
+			tokens[*nr_tokens].str = curr;
+			tokens[*nr_tokens].len = 1;
+			*nr_tokens += 1;
+			token_started = true;
+		}
+		curr++;
+	}
+
+	return 0;
+}
+#endif
+
+/***********************************************************************
+ * Library entry points
+ */
+int mipsasm_translate_line(const char *line, size_t len, uint32_t *word)
+{
+	Token tokens[MAX_NR_TOKENS];
+	int nr_tokens;
+
+	parse_command(line, len, &nr_tokens, tokens);
+	if (nr_tokens == 0)
+	{
+		*word = 0;
+		return MIPSASM_BLANK;
+	}
+	return translate(nr_tokens, tokens, word);
+}
+
+/***********************************************************************
+ * Line cache
+ */
+#define CACHE_PROBES 8
+
+void mipsasm_cache_init(struct mipsasm_cache *cache)
+{
+	memset(cache, 0, sizeof(*cache));
+}
+
+/*
+ * Build the key of a line from its first four tokens into @key and hash it
+ * (FNV-1a) on the way. Return the key length, or 0 if it does not fit.
+ */
+static size_t cache_key(const Token *tokens, int nr_tokens, char *key, uint32_t *hash)
+{
+	uint32_t h = 2166136261u;
+	size_t len = 0;
+
+	if (nr_tokens > 4)
+		nr_tokens = 4;
+
+	for (int t = 0; t < nr_tokens; t++)
+	{
+		if (len + tokens[t].len + (t > 0) > MIPSASM_CACHE_KEY_LEN)
+			return 0;
+		if (t > 0)
+			key[len++] = ' ';
+		for (int i = 0; i < tokens[t].len; i++)
+		{
+			unsigned char c = tokens[t].str[i];
+
+			c |= (unsigned char)((unsigned int)(c - 'A') < 26) << 5; // fold 'A'..'Z'
+			key[len++] = c;
+			h = (h ^ c) * 16777619u;
+		}
+		h = (h ^ ' ') * 16777619u;
+	}
+
+	*hash = h;
+	return len;
+}
+
+int mipsasm_translate_line_cached(struct mipsasm_cache *cache, const char *line, size_t len,
+								  uint32_t *word)
+{
+	Token tokens[MAX_NR_TOKENS];
+	struct mipsasm_cache_entry *entry, *victim = NULL;
+	char key[MIPSASM_CACHE_KEY_LEN];
+	size_t key_len;
+	uint32_t hash;
+	int nr_tokens, status;
+
+	parse_command(line, len, &nr_tokens, tokens);
+	if (nr_tokens == 0)
+	{
+		*word = 0;
+		return MIPSASM_BLANK;
+	}
+
+	key_len = cache_key(tokens, nr_tokens, key, &hash);
+	for (int probe = 0; key_len && probe < CACHE_PROBES; probe++)
+	{
+		entry = &cache->entries[(hash + probe) & (MIPSASM_CACHE_SLOTS - 1)];
+		if (entry->len == key_len && memcmp(entry->key, key, key_len) == 0)
+		{
+			cache->hits++;
+			*word = entry->word;
+			return entry->status;
+		}
+		if (entry->len == 0 && !victim)
+			victim = entry;
+	}
+
+	cache->misses++;
+	status = translate(nr_tokens, tokens, word);
+	if (key_len)
+	{
+		/* With no free slot in reach, the home slot gives way */
+		if (!victim)
+			victim = &cache->entries[hash & (MIPSASM_CACHE_SLOTS - 1)];
+		victim->word = *word;
+		victim->status = status;
+		victim->len = key_len;
+		memcpy(victim->key, key, key_len);
+	}
+	return status;
+}
+
+/***********************************************************************
+ * Batch translation
+ *
+ * Without a cache, lines are decoded DECODE_BATCH at a time into columns
+ * and then packed together.
+ */
+#define DECODE_BATCH 256
+
+size_t mipsasm_translate_buffer(const char *buf, size_t len, uint32_t words[], uint8_t status[],
+								size_t max_lines, size_t *consumed, struct mipsasm_cache *cache)
+{
+	uint32_t columns[NR_COLUMNS][DECODE_BATCH];
+	const char *line = buf, *end = buf + len;
+	size_t nr_lines = 0;
+
+	while (line < end && nr_lines < max_lines)
+	{
+		size_t first = nr_lines, lane;
+
+		for (lane = 0; lane < DECODE_BATCH && line < end && nr_lines < max_lines; lane++)
+		{
+			const char *eol = memchr(line, '\n', end - line);
+			Token tokens[MAX_NR_TOKENS];
+			int nr_tokens;
+
+			if (!eol)
+				eol = end;
+			if (cache)
+			{
+				status[nr_lines] = mipsasm_translate_line_cached(cache, line, eol - line, &words[nr_lines]);
+			}
+			else
+			{
+				parse_command(line, eol - line, &nr_tokens, tokens);
+				status[nr_lines] = decode(nr_tokens, tokens, &columns[0][lane], DECODE_BATCH);
+				if (nr_tokens == 0)
+					status[nr_lines] = MIPSASM_BLANK;
+			}
+			nr_lines++;
+			line = eol < end ? eol + 1 : end;
+		}
+
+		if (!cache)
+			pack_columns(&columns[0][0], DECODE_BATCH, lane, words + first);
+	}
+
+	*consumed = line - buf;
+	return nr_lines;
+}
+
+/***********************************************************************
+ * Labels
+ */
+static bool is_label_name(const char *name, size_t len)
+{
+	if (len == 0 || isdigit((unsigned char)name[0]))
+		return false;
+	for (size_t i = 0; i < len; i++)
+	{
+		if (!isalnum((unsigned char)name[i]) && name[i] != '_' && name[i] != '.')
+			return false;
+	}
+	return true;
+}
+
+size_t mipsasm_label(const char *line, size_t len, const char **name, size_t *name_len)
+{
+	Token tokens[MAX_NR_TOKENS];
+	int nr_tokens;
+
+	parse_command(line, len, &nr_tokens, tokens);
+	if (nr_tokens == 0 || tokens[0].str[tokens[0].len - 1] != ':' ||
+		!is_label_name(tokens[0].str, tokens[0].len - 1))
+		return 0;
+
+	*name = tokens[0].str;
+	*name_len = tokens[0].len - 1;
+	return tokens[0].str + tokens[0].len - line;
+}
+
+/* Whether @tokens[] are a beq/bne with a label for offset */
+static bool is_branch_label(int nr_tokens, const Token tokens[])
+{
+	const InstructionInfo *info;
+
+	if (nr_tokens < 4 || !(info = detectType(&tokens[0])))
+		return false;
+	if (info->base >> 26 != 0x04 && info->base >> 26 != 0x05)
+		return false;
+	return is_label_name(tokens[3].str, tokens[3].len);
+}
+
+int mipsasm_branch_label(const char *line, size_t len, const char **name, size_t *name_len)
+{
+	Token tokens[MAX_NR_TOKENS];
+	int nr_tokens;
+
+	parse_command(line, len, &nr_tokens, tokens);
+	if (!is_branch_label(nr_tokens, tokens))
+		return 0;
+
+	*name = tokens[3].str;
+	*name_len = tokens[3].len;
+	return 1;
+}
+
+int mipsasm_translate_branch(const char *line, size_t len, int32_t offset, uint32_t *word)
+{
+	Token tokens[MAX_NR_TOKENS];
+	int nr_tokens, status;
+
+	*word = 0;
+	parse_command(line, len, &nr_tokens, tokens);
+	if (!is_branch_label(nr_tokens, tokens))
+		return translate(nr_tokens, tokens, word);
+	if (offset < -0x8000 || offset > 0x7fff)
+		return MIPSASM_ERR_IMMEDIATE;
+
+	/* Encode the rest with offset 0, then put the offset in the imm16 field */
+	tokens[3] = (Token){"0", 1};
+	status = translate(nr_tokens, tokens, word);
+	if (status == MIPSASM_OK)
+		*word |= (uint32_t)offset & fields[FIELD_IMM].mask;
+	return status;
+}
+
+const char *mipsasm_strerror(int status)
+{
+	switch (status)
+	{
+	case MIPSASM_OK:
+		return "ok";
+	case MIPSASM_BLANK:
+		return "blank line";
+	case MIPSASM_ERR_COMMAND:
+		return "wrong command";
+	case MIPSASM_ERR_REGISTER:
+		return "wrong register";
+	case MIPSASM_ERR_IMMEDIATE:
+		return "wrong immediate";
+	}
+	return "unknown status";
+}
@@ -0,0 +1,126 @@
+/**********************************************************************
+ * Copyright (c) 2021-2023
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/***********************************************************************
+ * libmipsasm
+ *
+ *   The translator behind pa1 as a library. No function allocates, and
+ *   none reads past the @len bytes of the caller's buffers it is given.
+ *   Those that take no struct mipsasm_cache, or a NULL one, are pure: they
+ *   read only those bytes and constant tables, and can be called from any
+ *   number of threads at once. mipsasm_cache_init(),
+ *   mipsasm_translate_line_cached() and mipsasm_translate_buffer() with a
+ *   cache write to it, so a cache must be used by one thread at a time;
+ *   see the memoization below.
+ */
+#ifndef __MIPSASM_H__
+#define __MIPSASM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Per-line status */
+enum mipsasm_status
+{
+	MIPSASM_OK = 0,
+	MIPSASM_BLANK,		   /* no tokens on the line; there is no word */
+	MIPSASM_ERR_COMMAND,   /* unknown mnemonic or missing operands */
+	MIPSASM_ERR_REGISTER,  /* unknown register name */
+	MIPSASM_ERR_IMMEDIATE, /* malformed or out-of-range shamt/immediate */
+};
+
+/*
+ * Translate one line of @len bytes at @line, which need not be
+ * NUL-terminated, and store the instruction to @word. @word is 0 unless
+ * MIPSASM_OK is returned.
+ */
+int mipsasm_translate_line(const char *line, size_t len, uint32_t *word);
+
+/*
+ * Memoization of translated lines. A line is keyed by its first four tokens,
+ * case-folded and joined by single spaces; nothing after the fourth token
+ * reaches the translator, so trailing comments do not split entries. The
+ * cache is a fixed-size open-addressed table owned by the caller, so use one
+ * per thread. Lines whose key does not fit MIPSASM_CACHE_KEY_LEN bypass it.
+ */
+#define MIPSASM_CACHE_SLOTS 4096 /* power of two */
+#define MIPSASM_CACHE_KEY_LEN 42
+
+struct mipsasm_cache_entry
+{
+	uint32_t word;
+	uint8_t status;
+	uint8_t len; /* key length; 0 marks a free slot */
+	char key[MIPSASM_CACHE_KEY_LEN];
+};
+
+struct mipsasm_cache
+{
+	uint64_t hits;
+	uint64_t misses;
+	struct mipsasm_cache_entry entries[MIPSASM_CACHE_SLOTS];
+};
+
+void mipsasm_cache_init(struct mipsasm_cache *cache);
+
+/* mipsasm_translate_line() that looks in, and fills, @cache first */
+int mipsasm_translate_line_cached(struct mipsasm_cache *cache, const char *line, size_t len,
+								  uint32_t *word);
+
+/*
+ * Translate the '\n'-separated lines in @len bytes of @buf. Line i gets
+ * @words[i] and @status[i], blank lines included, so indexes follow the
+ * source lines. At most @max_lines lines are translated; the number of
+ * bytes they span, newlines included, is stored to @consumed so the caller
+ * can resume from there. A last line without '\n' counts as a line.
+ * @cache may be NULL.
+ *
+ * Return the number of lines translated.
+ */
+size_t mipsasm_translate_buffer(const char *buf, size_t len, uint32_t words[], uint8_t status[],
+								size_t max_lines, size_t *consumed, struct mipsasm_cache *cache);
+
+/*
+ * Labels. A line may start with a "name:" token, which labels the word the
+ * rest of the line translates to, and beq/bne may name a label in place of
+ * their offset. Names are a letter, '_' or '.' followed by letters, digits,
+ * '_' and '.', and are case-sensitive. The functions above know nothing of
+ * other lines, so such lines fail there: a label fails with
+ * MIPSASM_ERR_COMMAND and a branch to one with MIPSASM_ERR_IMMEDIATE.
+ * Callers that resolve labels look at those lines again with these.
+ *
+ * mipsasm_label() stores the label @line defines to @name and @name_len and
+ * returns the number of bytes up to and including its ':', or 0 if @line
+ * defines none.
+ */
+size_t mipsasm_label(const char *line, size_t len, const char **name, size_t *name_len);
+
+/*
+ * If @line is a beq/bne whose offset names a label, store the name to @name
+ * and @name_len and return 1; otherwise return 0.
+ */
+int mipsasm_branch_label(const char *line, size_t len, const char **name, size_t *name_len);
+
+/*
+ * Translate the beq/bne @line as if its label were @offset, in words from
+ * the instruction after it. Offsets outside -0x8000..0x7fff fail with
+ * MIPSASM_ERR_IMMEDIATE.
+ */
+int mipsasm_translate_branch(const char *line, size_t len, int32_t offset, uint32_t *word);
+
+/* Message for a status, e.g. "wrong register" */
+const char *mipsasm_strerror(int status);
+
+#endif
@@ -18,232 +18,2586 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#ifdef __linux__
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "mipsasm.h"
+#include "serve.h"
+#include "whitespace.h"
 
 /* To avoid security error on Visual Studio */
 #define _CRT_SECURE_NO_WARNINGS
 #pragma warning(disable : 4996)
 
-/*====================================================================*/
-/*          ****** DO NOT MODIFY ANYTHING FROM THIS LINE ******       */
-#define MAX_NR_TOKENS 16 /* Maximum length of tokens in a command */
-#define MAX_TOKEN_LEN 32 /* Maximum length of single token */
-#define MAX_ASSEMBLY 128 /* Maximum length of assembly string */
+/*====================================================================*/
+/*          ****** DO NOT MODIFY ANYTHING FROM THIS LINE ******       */
+#define MAX_NR_TOKENS 16 /* Maximum length of tokens in a command */
+#define MAX_TOKEN_LEN 32 /* Maximum length of single token */
+#define MAX_ASSEMBLY 128 /* Maximum length of assembly string */
+
+typedef unsigned char bool;
+#define true 1
+#define false 0
+/*          ****** DO NOT MODIFY ANYTHING UP TO THIS LINE ******      */
+/*====================================================================*/
+
+/***********************************************************************
+ * Output channel
+ *
+ * The interactive translator prints each word to stderr as soon as it is
+ * translated. With -o FILE or --stdout, the formatted words are collected
+ * in a large buffer instead and handed to write(2) in big chunks. Worker
+ * threads collect their words in memory-only outputs that grow as needed,
+ * or in fixed regions of a mapped output file sized for them up front.
+ *
+ * --format=bin writes each word as 4 raw bytes instead of a line of hex, in
+ * big-endian order unless --endian=little is given. Binary output always
+ * goes through the buffer.
+ *
+ * Lines that fail are reported on stdout as "line N: what", where the
+ * banner and prompts of stdin sources go too. With --stdout the words own
+ * stdout, so failures are reported on stderr and there is no banner or
+ * prompt. Workers that cannot know the number of their first line keep
+ * their failures until the writer does.
+ */
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define OUTPUT_STDERR -1 /* unbuffered stderr, the default */
+#define OUTPUT_MEMORY -2 /* growable in-memory buffer */
+#define OUTPUT_FIXED -3	 /* preallocated region that must not overflow */
+
+enum
+{
+	FORMAT_TEXT,	   /* "0x%08x\n" */
+	FORMAT_BIN_BIG,	   /* 4 bytes, most significant first */
+	FORMAT_BIN_LITTLE, /* 4 bytes, least significant first */
+};
+
+/* A line that failed, kept until the lines before it are counted */
+struct failure
+{
+	uint64_t line_no;
+	int status;
+};
+
+struct output
+{
+	int fd;			  /* file descriptor, or OUTPUT_STDERR/MEMORY/FIXED */
+	int format;
+	bool prompt;	  /* print ">> " on stdout after every input line */
+	FILE *reports;	  /* where lines that fail are reported; NULL for stdout */
+	uint64_t line_no; /* number of the last line emitted */
+	bool defer;		  /* keep lines that fail in @failed instead of reporting them */
+	struct failure *failed;
+	size_t nr_failed, cap_failed;
+	uint64_t bytes; /* bytes emitted so far */
+	size_t len;		/* bytes pending in @buf */
+	size_t cap;
+	char *buf;
+};
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t ret = write(fd, buf, len);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static int output_flush(struct output *out)
+{
+	if (out->fd < 0)
+		return 0;
+
+	if (write_all(out->fd, out->buf, out->len) < 0)
+		return -1;
+	out->len = 0;
+	return 0;
+}
+
+/*
+ * Format @word as "0x%08x\n" without going through printf: each nibble
+ * indexes the digit table directly.
+ */
+#define WORD_TEXT_LEN 11
+#define WORD_BIN_LEN 4
+#define WORD_LEN(format) ((format) == FORMAT_TEXT ? WORD_TEXT_LEN : WORD_BIN_LEN)
+
+static inline void format_word(char *buf, unsigned int word)
+{
+	static const char digits[16] = "0123456789abcdef";
+
+	buf[0] = '0';
+	buf[1] = 'x';
+	for (int i = 0; i < 8; i++)
+	{
+		buf[2 + i] = digits[(word >> (28 - 4 * i)) & 0xf];
+	}
+	buf[10] = '\n';
+}
+
+/* Append @len bytes that are already formatted, e.g. a worker's output */
+static int output_bytes(struct output *out, const char *buf, size_t len)
+{
+	out->bytes += len;
+	if (out->fd == OUTPUT_STDERR)
+		return fwrite(buf, 1, len, stderr) == len ? 0 : -1;
+
+	if (output_flush(out) < 0)
+		return -1;
+	return write_all(out->fd, buf, len);
+}
+
+static int output_word(struct output *out, unsigned int word)
+{
+	if (out->fd == OUTPUT_STDERR)
+	{
+		char buf[WORD_TEXT_LEN];
+
+		format_word(buf, word);
+		out->bytes += WORD_TEXT_LEN;
+		return fwrite(buf, 1, WORD_TEXT_LEN, stderr) == WORD_TEXT_LEN ? 0 : -1;
+	}
+
+	if (out->len + WORD_LEN(out->format) > out->cap)
+	{
+		if (out->fd == OUTPUT_FIXED)
+		{
+			errno = ENOSPC;
+			return -1;
+		}
+		if (out->fd == OUTPUT_MEMORY)
+		{
+			size_t cap = out->cap ? out->cap * 2 : OUTPUT_BUFFER_SIZE;
+			char *buf = realloc(out->buf, cap);
+
+			if (!buf)
+				return -1;
+			out->buf = buf;
+			out->cap = cap;
+		}
+		else if (output_flush(out) < 0)
+		{
+			return -1;
+		}
+	}
+
+	switch (out->format)
+	{
+	case FORMAT_TEXT:
+		format_word(out->buf + out->len, word);
+		out->len += WORD_TEXT_LEN;
+		out->bytes += WORD_TEXT_LEN;
+		break;
+	case FORMAT_BIN_BIG:
+		for (int i = 0; i < 4; i++)
+		{
+			out->buf[out->len++] = (char)(word >> (24 - 8 * i));
+		}
+		out->bytes += 4;
+		break;
+	case FORMAT_BIN_LITTLE:
+		for (int i = 0; i < 4; i++)
+		{
+			out->buf[out->len++] = (char)(word >> (8 * i));
+		}
+		out->bytes += 4;
+		break;
+	}
+	return 0;
+}
+
+/***********************************************************************
+ * Run statistics (--stats)
+ *
+ * Every thread counts into a struct stats of its own, so the hot loops
+ * touch no shared cache lines and take no locks; workers add theirs up
+ * when they finish. Lines are counted a batch at a time after the batch
+ * is translated, and the stages are timed per batch, so leaving --stats
+ * on costs a few clock reads per BATCH_LINES lines. Stage times are summed
+ * over threads, and the utilization of a stage is its time over the wall
+ * time: the number of threads busy in it on average. A mapped source is
+ * read by the page faults taken while it is translated, which therefore
+ * count towards "translate".
+ */
+enum
+{
+	STAGE_READ,
+	STAGE_TRANSLATE,
+	STAGE_OUTPUT,
+	NR_STAGES,
+};
+
+/* Formats of the words emitted, told apart by their opcode and funct */
+enum
+{
+	WORD_R,
+	WORD_SHIFT,
+	WORD_I,
+	NR_WORD_FORMATS,
+};
+
+#define NR_STATUS (MIPSASM_ERR_IMMEDIATE + 1)
+
+struct stats
+{
+	uint64_t lines;
+	uint64_t bytes_in;
+	uint64_t status[NR_STATUS];		   /* lines by mipsasm_status */
+	uint64_t words[NR_WORD_FORMATS];   /* MIPSASM_OK lines by format */
+	uint64_t stage_ns[NR_STAGES];
+};
+
+static inline uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline int word_format(uint32_t word)
+{
+	if (word >> 26)
+		return WORD_I;
+	return (word & 0x3f) < 0x20 ? WORD_SHIFT : WORD_R; // sll/srl/sra vs add..nor
+}
+
+static inline void count_line(struct stats *stats, int status, uint32_t word)
+{
+	stats->lines++;
+	stats->status[status]++;
+	if (status == MIPSASM_OK)
+		stats->words[word_format(word)]++;
+}
+
+static void stats_add(struct stats *sum, const struct stats *stats)
+{
+	sum->lines += stats->lines;
+	sum->bytes_in += stats->bytes_in;
+	for (int i = 0; i < NR_STATUS; i++)
+		sum->status[i] += stats->status[i];
+	for (int i = 0; i < NR_WORD_FORMATS; i++)
+		sum->words[i] += stats->words[i];
+	for (int i = 0; i < NR_STAGES; i++)
+		sum->stage_ns[i] += stats->stage_ns[i];
+}
+
+/* One line of JSON; @cache may be NULL */
+static void stats_report(FILE *stream, const struct stats *stats, uint64_t bytes_out, int nr_threads,
+						 uint64_t wall_ns, const struct mipsasm_cache *cache)
+{
+	double wall_s = wall_ns / 1e9;
+
+	fprintf(stream,
+			"{\"lines\": %" PRIu64 ", \"blank\": %" PRIu64
+			", \"instructions\": {\"r\": %" PRIu64 ", \"shift\": %" PRIu64 ", \"i\": %" PRIu64 "}"
+			", \"errors\": {\"command\": %" PRIu64 ", \"register\": %" PRIu64 ", \"immediate\": %" PRIu64 "}"
+			", \"bytes_in\": %" PRIu64 ", \"bytes_out\": %" PRIu64 ", \"threads\": %d",
+			stats->lines, stats->status[MIPSASM_BLANK],
+			stats->words[WORD_R], stats->words[WORD_SHIFT], stats->words[WORD_I],
+			stats->status[MIPSASM_ERR_COMMAND], stats->status[MIPSASM_ERR_REGISTER],
+			stats->status[MIPSASM_ERR_IMMEDIATE], stats->bytes_in, bytes_out, nr_threads);
+	fprintf(stream, ", \"wall_s\": %.6f, \"stage_s\": {\"read\": %.6f, \"translate\": %.6f, \"output\": %.6f}",
+			wall_s, stats->stage_ns[STAGE_READ] / 1e9, stats->stage_ns[STAGE_TRANSLATE] / 1e9,
+			stats->stage_ns[STAGE_OUTPUT] / 1e9);
+	fprintf(stream, ", \"utilization\": {\"read\": %.3f, \"translate\": %.3f, \"output\": %.3f}",
+			wall_ns ? (double)stats->stage_ns[STAGE_READ] / wall_ns : 0.0,
+			wall_ns ? (double)stats->stage_ns[STAGE_TRANSLATE] / wall_ns : 0.0,
+			wall_ns ? (double)stats->stage_ns[STAGE_OUTPUT] / wall_ns : 0.0);
+	fprintf(stream, ", \"lines_per_sec\": %.0f, \"mb_per_sec\": %.2f",
+			wall_ns ? stats->lines / wall_s : 0.0, wall_ns ? stats->bytes_in / wall_s / 1e6 : 0.0);
+	if (cache)
+		fprintf(stream, ", \"cache\": {\"hits\": %" PRIu64 ", \"misses\": %" PRIu64 "}", cache->hits,
+				cache->misses);
+	fprintf(stream, "}\n");
+}
+
+/* Make room for one more of @size bytes in *@array of *@cap */
+static int reserve_one(void **array, size_t nr, size_t *cap, size_t size)
+{
+	void *grown;
+
+	if (nr < *cap)
+		return 0;
+	if (!(grown = realloc(*array, (*cap ? *cap * 2 : 1024) * size)))
+		return -1;
+	*array = grown;
+	*cap = *cap ? *cap * 2 : 1024;
+	return 0;
+}
+
+static void report_line(FILE *reports, uint64_t line_no, int status)
+{
+	fprintf(reports ? reports : stdout, "line %" PRIu64 ": %s\n", line_no, mipsasm_strerror(status));
+}
+
+/* Report the lines that failed in @out, whose first line is @base + 1 */
+static void report_deferred(struct output *out, FILE *reports, uint64_t base)
+{
+	for (size_t i = 0; i < out->nr_failed; i++)
+	{
+		report_line(reports, base + out->failed[i].line_no, out->failed[i].status);
+	}
+	out->nr_failed = 0;
+}
+
+/* Emit the 0 of a line that failed and has been reported already */
+static int output_failed(struct output *out)
+{
+	out->line_no++;
+	return output_word(out, 0);
+}
+
+/*
+ * Emit the word of one translated line. Blank lines produce no word; lines
+ * that do not translate are reported and produce 0.
+ */
+static int output_line(struct output *out, int status, uint32_t word)
+{
+	out->line_no++;
+	if (status == MIPSASM_BLANK)
+		return 0;
+	if (status != MIPSASM_OK)
+	{
+		if (!out->defer)
+		{
+			report_line(out->reports, out->line_no, status);
+		}
+		else
+		{
+			if (reserve_one((void **)&out->failed, out->nr_failed, &out->cap_failed, sizeof(*out->failed)) < 0)
+				return -1;
+			out->failed[out->nr_failed++] = (struct failure){out->line_no, status};
+		}
+	}
+	return output_word(out, word);
+}
+
+/***********************************************************************
+ * Labels
+ *
+ * Lines may define labels ("loop:") and beq/bne may branch to them by name;
+ * see mipsasm_label(). Sources are still read once. A branch to a label
+ * that is not defined yet is translated with offset 0 and goes on the
+ * fixup list of the label, to be patched when the label turns up. The
+ * output cannot be rewound, so the words from the first unpatched branch
+ * on are held back until no branch is left unpatched. A branch that is
+ * still unpatched 0x8000 words on could not reach its label any more, so
+ * it fails there and no more than that many words are ever held. Branches
+ * out of reach or to labels that never turn up are wrong immediates; a
+ * label defined twice keeps its first word. Each is reported once, on
+ * stderr with its line.
+ *
+ * Lines with labels fail in the library, so lines that translate are not
+ * looked at again and sources without labels cost one compare per line.
+ * Labels need the lines in order: -j translates sources where a line
+ * defines a label in one thread, and --lines, --incremental and --serve do
+ * not resolve labels at all. Elsewhere a branch to a label is just a
+ * wrong immediate.
+ */
+#define NO_FIXUP SIZE_MAX
+
+struct symbol
+{
+	char *name; /* NULL for free entries */
+	bool defined;
+	uint64_t word;	/* index of the word it labels, once defined */
+	size_t fixups; /* last branch waiting for it, or NO_FIXUP */
+};
+
+struct fixup
+{
+	size_t held;	  /* index of its word in labels.held, NO_FIXUP once patched */
+	uint64_t word;	  /* index of its word in the output */
+	uint64_t line_no; /* for the report */
+	const char *name;
+	size_t next;  /* the branch waiting for the same label before it */
+	bool expired; /* failed out of reach while still on the list of its label */
+};
+
+struct held_word
+{
+	uint32_t word;
+	uint8_t status;
+	bool reported; /* failed and reported already */
+};
+
+struct labels
+{
+	struct symbol *symbols; /* open-addressed, by name */
+	size_t mask, nr_symbols;
+	struct fixup *fixups;
+	size_t nr_fixups, cap_fixups;
+	struct held_word *held;
+	size_t nr_held, cap_held;
+	size_t nr_pending; /* branches not patched yet */
+	size_t oldest;	   /* no branch before this fixup is pending */
+	uint64_t nr_words; /* words emitted or held so far */
+	uint64_t nr_lines; /* lines seen, but for the batch being emitted */
+};
+
+static inline size_t symbol_slot(const struct labels *labels, const char *name, size_t len)
+{
+	uint32_t h = 2166136261u;
+
+	for (size_t i = 0; i < len; i++)
+		h = (h ^ (unsigned char)name[i]) * 16777619u;
+	for (h &= labels->mask; labels->symbols[h].name; h = (h + 1) & labels->mask)
+	{
+		if (strncmp(labels->symbols[h].name, name, len) == 0 && !labels->symbols[h].name[len])
+			break;
+	}
+	return h;
+}
+
+/* The symbol of @name, added if it is new; NULL if out of memory */
+static struct symbol *symbol_get(struct labels *labels, const char *name, size_t len)
+{
+	struct symbol *symbol;
+
+	if (2 * (labels->nr_symbols + 1) > labels->mask + 1)
+	{
+		struct labels grown = *labels;
+
+		grown.mask = labels->symbols ? 2 * labels->mask + 1 : 255;
+		if (!(grown.symbols = calloc(grown.mask + 1, sizeof(*grown.symbols))))
+			return NULL;
+		for (size_t i = 0; labels->symbols && i <= labels->mask; i++)
+		{
+			struct symbol *old = &labels->symbols[i];
+
+			if (old->name)
+				grown.symbols[symbol_slot(&grown, old->name, strlen(old->name))] = *old;
+		}
+		free(labels->symbols);
+		labels->symbols = grown.symbols;
+		labels->mask = grown.mask;
+	}
+
+	symbol = &labels->symbols[symbol_slot(labels, name, len)];
+	if (!symbol->name)
+	{
+		if (!(symbol->name = strndup(name, len)))
+			return NULL;
+		symbol->fixups = NO_FIXUP;
+		labels->nr_symbols++;
+	}
+	return symbol;
+}
+
+/* Fail the pending branch of @fixup, because its label is @what */
+static void fixup_fail(struct labels *labels, struct fixup *fixup, const char *what)
+{
+	fprintf(stderr, "line %" PRIu64 ": label %s is %s\n", fixup->line_no, fixup->name, what);
+	labels->held[fixup->held] = (struct held_word){0, MIPSASM_ERR_IMMEDIATE, true};
+	fixup->held = NO_FIXUP;
+	labels->nr_pending--;
+}
+
+/*
+ * Patch the branches waiting for @symbol, which labels the next word. They
+ * are all in reach; labels_expire() has failed the others.
+ */
+static void label_define(struct labels *labels, struct symbol *symbol)
+{
+	symbol->defined = true;
+	symbol->word = labels->nr_words;
+	for (size_t f = symbol->fixups; f != NO_FIXUP; f = labels->fixups[f].next)
+	{
+		struct fixup *fixup = &labels->fixups[f];
+
+		if (fixup->held == NO_FIXUP)
+			continue;
+		labels->held[fixup->held].word |= symbol->word - (fixup->word + 1);
+		fixup->held = NO_FIXUP;
+		labels->nr_pending--;
+	}
+	symbol->fixups = NO_FIXUP;
+}
+
+/* Fail the branches that their label could not reach if it turned up now */
+static void labels_expire(struct labels *labels)
+{
+	for (; labels->oldest < labels->nr_fixups; labels->oldest++)
+	{
+		struct fixup *fixup = &labels->fixups[labels->oldest];
+
+		if (fixup->held == NO_FIXUP)
+			continue;
+		if (labels->nr_words - fixup->word <= 0x8000)
+			break;
+		fixup->expired = true;
+		fixup_fail(labels, fixup, "out of reach");
+	}
+}
+
+/* Emit the held words; no branch may be pending */
+static int labels_flush(struct labels *labels, struct output *out)
+{
+	for (size_t i = 0; i < labels->nr_held; i++)
+	{
+		struct held_word *held = &labels->held[i];
+
+		if ((held->reported ? output_failed(out) : output_line(out, held->status, held->word)) < 0)
+			return -1;
+	}
+
+	/* The fixups go, so the labels that expired ones wait for must let go of them */
+	for (size_t f = 0; f < labels->nr_fixups; f++)
+	{
+		const char *name = labels->fixups[f].name;
+
+		if (labels->fixups[f].expired)
+			labels->symbols[symbol_slot(labels, name, strlen(name))].fixups = NO_FIXUP;
+	}
+	labels->nr_held = 0;
+	labels->nr_fixups = 0;
+	labels->oldest = 0;
+	return 0;
+}
+
+/* Whether label_line() needs the text of a line that translated to @status */
+static inline bool label_suspect(int status)
+{
+	return status == MIPSASM_ERR_COMMAND || status == MIPSASM_ERR_IMMEDIATE;
+}
+
+/*
+ * Emit line @line_no of @len bytes at @line, whose translation gave @status
+ * and @word, resolving its labels; @line may be NULL unless label_suspect().
+ * @status and @word are updated to what the line stands for. Return -1 if
+ * the output cannot be written or on running out of memory, with errno set.
+ */
+static int label_line(struct labels *labels, struct output *out, const char *line, size_t len, uint64_t line_no,
+					  uint8_t *status, uint32_t *word)
+{
+	const char *name;
+	size_t name_len, skip = 0;
+	struct symbol *symbol;
+	bool reported = false;
+
+	if (*status == MIPSASM_ERR_COMMAND && (skip = mipsasm_label(line, len, &name, &name_len)) > 0)
+	{
+		if (!(symbol = symbol_get(labels, name, name_len)))
+			return -1;
+		if (symbol->defined)
+			fprintf(stderr, "line %" PRIu64 ": label %s is already defined\n", line_no, symbol->name);
+		else
+			label_define(labels, symbol);
+		*status = mipsasm_translate_line(line + skip, len - skip, word);
+	}
+
+	if (*status == MIPSASM_ERR_IMMEDIATE && mipsasm_branch_label(line + skip, len - skip, &name, &name_len))
+	{
+		if (!(symbol = symbol_get(labels, name, name_len)))
+			return -1;
+		if (symbol->defined)
+		{
+			int64_t offset = (int64_t)symbol->word - (int64_t)(labels->nr_words + 1);
+
+			*status = mipsasm_translate_branch(line + skip, len - skip, offset < -0x8000 ? 0 : offset, word);
+			if (*status == MIPSASM_OK && offset < -0x8000)
+			{
+				fprintf(stderr, "line %" PRIu64 ": label %s is out of reach\n", line_no, symbol->name);
+				*status = MIPSASM_ERR_IMMEDIATE;
+				*word = 0;
+				reported = true;
+			}
+		}
+		else if ((*status = mipsasm_translate_branch(line + skip, len - skip, 0, word)) == MIPSASM_OK)
+		{
+			if (reserve_one((void **)&labels->fixups, labels->nr_fixups, &labels->cap_fixups,
+							sizeof(*labels->fixups)) < 0)
+				return -1;
+			labels->fixups[labels->nr_fixups] = (struct fixup){
+				.held = labels->nr_held,
+				.word = labels->nr_words,
+				.line_no = line_no,
+				.name = symbol->name,
+				.next = symbol->fixups,
+			};
+			symbol->fixups = labels->nr_fixups++;
+			labels->nr_pending++;
+		}
+	}
+
+	labels->nr_words += *status != MIPSASM_BLANK;
+	if (!labels->nr_held && !labels->nr_pending)
+		return reported ? output_failed(out) : output_line(out, *status, *word);
+
+	if (reserve_one((void **)&labels->held, labels->nr_held, &labels->cap_held, sizeof(*labels->held)) < 0)
+		return -1;
+	labels->held[labels->nr_held++] = (struct held_word){*word, *status, reported};
+	labels_expire(labels);
+	return labels->nr_pending ? 0 : labels_flush(labels, out);
+}
+
+/* Report the branches to labels that never turned up, and emit what is held */
+static int labels_finish(struct labels *labels, struct output *out)
+{
+	for (size_t f = 0; f < labels->nr_fixups; f++)
+	{
+		struct fixup *fixup = &labels->fixups[f];
+
+		if (fixup->held != NO_FIXUP)
+			fixup_fail(labels, fixup, "not defined");
+	}
+	return labels_flush(labels, out);
+}
+
+static void labels_free(struct labels *labels)
+{
+	for (size_t i = 0; labels->symbols && i <= labels->mask; i++)
+		free(labels->symbols[i].name);
+	free(labels->symbols);
+	free(labels->fixups);
+	free(labels->held);
+}
+
+/* Whether a line of the @size bytes at @map defines a label; only lines with a ':' can */
+static bool defines_labels(const char *map, size_t size)
+{
+	const char *end = map + size, *colon = map;
+
+	while ((colon = memchr(colon, ':', end - colon)))
+	{
+		const char *line = colon, *eol = memchr(colon, '\n', end - colon), *name;
+		size_t name_len;
+
+		while (line > map && line[-1] != '\n')
+			line--;
+		if (mipsasm_label(line, (eol ? eol : end) - line, &name, &name_len))
+			return true;
+		if (!eol)
+			break;
+		colon = eol + 1;
+	}
+	return false;
+}
+
+/* @labels, @cache and @stats may be NULL here and below */
+static int translate_line(const char *line, size_t len, struct output *out, struct labels *labels,
+						  struct mipsasm_cache *cache, struct stats *stats)
+{
+	uint64_t start = stats ? monotonic_ns() : 0, translated;
+	uint32_t word;
+	uint8_t status;
+	int ret;
+
+	if (cache)
+		status = mipsasm_translate_line_cached(cache, line, len, &word);
+	else
+		status = mipsasm_translate_line(line, len, &word);
+	if (labels)
+		labels->nr_lines++;
+	if (!stats)
+		return labels ? label_line(labels, out, line, len, labels->nr_lines, &status, &word)
+					  : output_line(out, status, word);
+
+	translated = monotonic_ns();
+	ret = labels ? label_line(labels, out, line, len, labels->nr_lines, &status, &word)
+				 : output_line(out, status, word);
+	stats->stage_ns[STAGE_TRANSLATE] += translated - start;
+	stats->stage_ns[STAGE_OUTPUT] += monotonic_ns() - translated;
+	stats->bytes_in += len;
+	count_line(stats, status, word);
+	return ret;
+}
+
+/*
+ * Batch mode for regular files: translate the lines straight out of a
+ * mapping of the whole source, so lines are neither copied nor cut at
+ * MAX_ASSEMBLY bytes. Lines go through the library BATCH_LINES at a time.
+ */
+#define BATCH_LINES 4096
+
+static int translate_mapped(const char *map, size_t size, struct output *out, struct labels *labels,
+							struct mipsasm_cache *cache, struct stats *stats)
+{
+	uint32_t words[BATCH_LINES];
+	uint8_t status[BATCH_LINES];
+
+	while (size > 0)
+	{
+		uint64_t start = stats ? monotonic_ns() : 0, translated = 0;
+		size_t consumed;
+		size_t nr_lines = mipsasm_translate_buffer(map, size, words, status, BATCH_LINES, &consumed, cache);
+		const char *line = map, *end = map + consumed; /* line @at of the batch */
+		size_t at = 0;
+
+		if (stats)
+			translated = monotonic_ns();
+		for (size_t i = 0; i < nr_lines; i++)
+		{
+			const char *eol;
+			int ret;
+
+			if (!labels)
+			{
+				ret = output_line(out, status[i], words[i]);
+			}
+			else if (!label_suspect(status[i]))
+			{
+				ret = label_line(labels, out, NULL, 0, 0, &status[i], &words[i]);
+			}
+			else
+			{
+				for (; at < i; at++)
+					line = (const char *)memchr(line, '\n', end - line) + 1;
+				eol = memchr(line, '\n', end - line);
+				ret = label_line(labels, out, line, (eol ? eol : end) - line, labels->nr_lines + i + 1,
+								 &status[i], &words[i]);
+			}
+			if (ret < 0)
+				return -1;
+			if (out->prompt)
+				printf(">> ");
+		}
+		if (labels)
+			labels->nr_lines += nr_lines;
+		if (stats)
+		{
+			stats->stage_ns[STAGE_TRANSLATE] += translated - start;
+			stats->stage_ns[STAGE_OUTPUT] += monotonic_ns() - translated;
+			stats->bytes_in += consumed;
+			for (size_t i = 0; i < nr_lines; i++)
+				count_line(stats, status[i], words[i]);
+		}
+		map += consumed;
+		size -= consumed;
+	}
+	return 0;
+}
+
+/***********************************************************************
+ * Line reader
+ *
+ * Sources that cannot be mapped (stdin, pipes) are read with read(2) into
+ * one buffer that is reused for the whole run. Lines are handed out as
+ * views into the buffer, whatever their length: a line that does not fit
+ * grows the buffer, so memory follows the longest line, not the input.
+ * Nothing is allocated per line.
+ */
+#define READER_BUFFER_SIZE (1 << 16)
+
+struct reader
+{
+	int fd;
+	bool eof;
+	size_t start; /* first byte not handed out yet */
+	size_t end;	  /* end of the bytes read */
+	size_t cap;
+	char *buf;
+};
+
+/*
+ * Store the next line, without its '\n', to @line and @len. A last line
+ * without '\n' counts as a line. The line stays valid until the next call.
+ *
+ * Return 1 if there is a line, 0 at the end of input, and -1 on errors.
+ */
+static int reader_next(struct reader *reader, const char **line, size_t *len)
+{
+	size_t scanned = reader->start;
+
+	for (;;)
+	{
+		char *eol = memchr(reader->buf + scanned, '\n', reader->end - scanned);
+		ssize_t ret;
+
+		if (eol || (reader->eof && reader->start < reader->end))
+		{
+			size_t stop = eol ? (size_t)(eol - reader->buf) : reader->end;
+
+			*line = reader->buf + reader->start;
+			*len = stop - reader->start;
+			reader->start = eol ? stop + 1 : stop;
+			return 1;
+		}
+		if (reader->eof)
+			return 0;
+
+		/* Keep the partial line, moved to the front or in a larger buffer */
+		scanned = reader->end - reader->start;
+		if (reader->start > 0)
+		{
+			memmove(reader->buf, reader->buf + reader->start, scanned);
+			reader->start = 0;
+			reader->end = scanned;
+		}
+		else if (reader->end == reader->cap)
+		{
+			size_t cap = reader->cap * 2;
+			char *buf = realloc(reader->buf, cap);
+
+			if (!buf)
+				return -1;
+			reader->buf = buf;
+			reader->cap = cap;
+		}
+
+		ret = read(reader->fd, reader->buf + reader->end, reader->cap - reader->end);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		reader->eof = ret == 0;
+		reader->end += ret;
+	}
+}
+
+/***********************************************************************
+ * Line index
+ *
+ * index_lines() finds the lines of a mapped source a block at a time: one
+ * vector compare gives a bit per '\n' and another a bit per byte that is
+ * not whitespace, and the lines are walked on those bits instead of on the
+ * bytes. Besides the number of lines it counts the words they translate
+ * to, which are the lines that are not blank, and can keep the offset of
+ * every LINE_INDEX_STRIDE-th line so that any line is found again with at
+ * most LINE_INDEX_STRIDE - 1 memchr() calls.
+ */
+#define LINE_INDEX_STRIDE 64
+
+#ifdef WS_BLOCK
+#define LINE_BLOCK WS_BLOCK
+
+typedef uint32_t LineMask;
+
+/* Bits of the '\n' and of the non-whitespace bytes of @block */
+static inline void line_masks(const char *block, LineMask *newlines, LineMask *ink)
+{
+	*newlines = newline_mask(block);
+	*ink = ~whitespace_mask(block) & WS_BLOCK_MASK;
+}
+#endif
+
+struct line_index
+{
+	size_t nr_lines; /* a last line without '\n' included */
+	size_t nr_words; /* lines that are not blank */
+	uint64_t *marks; /* offset of line i * LINE_INDEX_STRIDE, if kept */
+	size_t nr_marks;
+	size_t cap;
+};
+
+static int index_mark(struct line_index *index, uint64_t offset)
+{
+	if (index->nr_marks == index->cap)
+	{
+		size_t cap = index->cap ? index->cap * 2 : 1024;
+		uint64_t *grown = realloc(index->marks, cap * sizeof(*grown));
+
+		if (!grown)
+			return -1;
+		index->marks = grown;
+		index->cap = cap;
+	}
+	index->marks[index->nr_marks++] = offset;
+	return 0;
+}
+
+/* Count a line ending in '\n'; the next one starts at @next, if not @size */
+static inline int index_line(struct line_index *index, bool marks, uint64_t next, size_t size)
+{
+	if (++index->nr_lines % LINE_INDEX_STRIDE != 0 || !marks || next == size)
+		return 0;
+	return index_mark(index, next);
+}
+
+/*
+ * Index the @size bytes of lines at @map into @index, keeping the marks
+ * only if @marks. Free the marks with free(index->marks). Return 0, or -1
+ * if out of memory.
+ */
+static int index_lines(const char *map, size_t size, struct line_index *index, bool marks)
+{
+	size_t pos = 0;
+	bool ink = false; /* the current line has something to translate */
+
+	*index = (struct line_index){0};
+	if (size > 0 && marks && index_mark(index, 0) < 0)
+		return -1;
+
+#ifdef LINE_BLOCK
+	for (; pos + LINE_BLOCK <= size; pos += LINE_BLOCK)
+	{
+		LineMask newlines, rest;
+
+		line_masks(map + pos, &newlines, &rest);
+		while (newlines)
+		{
+			LineMask before = (newlines & -newlines) - 1;
+
+			index->nr_words += ink || (rest & before);
+			ink = false;
+			rest &= ~before;
+			if (index_line(index, marks, pos + __builtin_ctz(newlines) + 1, size) < 0)
+				return -1;
+			newlines &= newlines - 1;
+		}
+		ink |= rest != 0;
+	}
+#endif
+	for (; pos < size; pos++)
+	{
+		unsigned char c = map[pos];
+
+		if (c == '\n')
+		{
+			index->nr_words += ink;
+			ink = false;
+			if (index_line(index, marks, pos + 1, size) < 0)
+				return -1;
+		}
+		else if (c != ' ' && (c < '\t' || c > '\r'))
+		{
+			ink = true;
+		}
+	}
+
+	if (size > 0 && map[size - 1] != '\n')
+	{
+		index->nr_lines++;
+		index->nr_words += ink;
+	}
+	return 0;
+}
+
+/* Line @line (from 0) of the @size bytes at @map that @index was made of */
+static const char *index_seek(const struct line_index *index, const char *map, size_t size, size_t line)
+{
+	const char *curr;
+
+	if (line >= index->nr_lines)
+		return NULL;
+	curr = map + index->marks[line / LINE_INDEX_STRIDE];
+	for (size_t i = line % LINE_INDEX_STRIDE; i > 0; i--)
+	{
+		const char *eol = memchr(curr, '\n', map + size - curr);
+
+		curr = eol ? eol + 1 : map + size;
+	}
+	return curr;
+}
+
+/***********************************************************************
+ * Parallel batch mode (-j N)
+ *
+ * The mapped source is cut at newline boundaries into chunks of about
+ * CHUNK_SIZE bytes. Worker threads take the chunks in order and translate
+ * each one into its own memory output, while the main thread writes the
+ * finished chunks in source order. Workers stay at most CHUNK_WINDOW chunks
+ * ahead of the writer so memory use does not grow with the input. With
+ * --cache and --stats every worker has a cache and stats of its own; their
+ * counters are added up at the end.
+ */
+#define CHUNK_SIZE (1 << 20)
+#define CHUNK_WINDOW(nr_threads) (4 * (nr_threads))
+
+struct chunk
+{
+	const char *start;
+	size_t len;
+	struct output out;
+	bool done;
+};
+
+struct job
+{
+	struct chunk *chunks;
+	int nr_chunks;
+	int window;
+	int next;	 /* next chunk to hand to a worker */
+	int written; /* chunks written so far */
+	bool failed;
+	bool cached;
+	uint64_t hits, misses;
+	struct stats *stats; /* workers add theirs here */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static void *translate_worker(void *arg)
+{
+	struct job *job = arg;
+	struct mipsasm_cache *cache = NULL;
+	struct stats stats = {0};
+
+	/* A worker that cannot get a cache just runs without one */
+	if (job->cached && (cache = malloc(sizeof(*cache))))
+		mipsasm_cache_init(cache);
+
+	pthread_mutex_lock(&job->lock);
+	while (job->next < job->nr_chunks && !job->failed)
+	{
+		struct chunk *chunk;
+		int ret;
+
+		if (job->next >= job->written + job->window)
+		{
+			pthread_cond_wait(&job->cond, &job->lock);
+			continue;
+		}
+		chunk = &job->chunks[job->next++];
+		pthread_mutex_unlock(&job->lock);
+
+		ret = translate_mapped(chunk->start, chunk->len, &chunk->out, NULL, cache, job->stats ? &stats : NULL);
+
+		pthread_mutex_lock(&job->lock);
+		if (ret < 0)
+			job->failed = true;
+		chunk->done = true;
+		pthread_cond_broadcast(&job->cond);
+	}
+	if (cache)
+	{
+		job->hits += cache->hits;
+		job->misses += cache->misses;
+	}
+	if (job->stats)
+		stats_add(job->stats, &stats);
+	pthread_mutex_unlock(&job->lock);
+
+	free(cache);
+	return NULL;
+}
+
+/* Cut @size bytes at @map into chunks of whole lines; NULL if out of memory */
+static struct chunk *split_chunks(const char *map, size_t size, int *nr_chunks)
+{
+	struct chunk *chunks = calloc(size / CHUNK_SIZE + 1, sizeof(*chunks));
+	const char *start = map, *end = map + size;
+
+	*nr_chunks = 0;
+	while (chunks && start < end)
+	{
+		struct chunk *chunk = &chunks[(*nr_chunks)++];
+		const char *stop = start + CHUNK_SIZE < end ? start + CHUNK_SIZE : end;
+		const char *eol = memchr(stop - 1, '\n', end - stop + 1);
+
+		stop = eol ? eol + 1 : end;
+		chunk->start = start;
+		chunk->len = stop - start;
+		start = stop;
+	}
+	return chunks;
+}
+
+/* The workers' counters are added to @cache and @stats, if they are given */
+static int translate_parallel(const char *map, size_t size, int nr_threads, struct output *out,
+							  struct mipsasm_cache *cache, struct stats *stats)
+{
+	struct job job = {.window = CHUNK_WINDOW(nr_threads), .cached = cache != NULL, .stats = stats};
+	pthread_t *threads;
+	int nr_started = 0;
+	int ret = 0;
+
+	job.chunks = split_chunks(map, size, &job.nr_chunks);
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!job.chunks || !threads)
+	{
+		free(job.chunks);
+		free(threads);
+		return -1;
+	}
+
+	for (int i = 0; i < job.nr_chunks; i++)
+	{
+		job.chunks[i].out.fd = OUTPUT_MEMORY;
+		job.chunks[i].out.format = out->format;
+		job.chunks[i].out.defer = true;
+	}
+
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.cond, NULL);
+
+	for (int i = 0; i < nr_threads; i++)
+	{
+		if (pthread_create(&threads[i], NULL, translate_worker, &job) != 0)
+			break;
+		nr_started++;
+	}
+
+	/* Only the writer moves the window, so it cannot run the workers too */
+	if (nr_started == 0)
+	{
+		pthread_mutex_destroy(&job.lock);
+		pthread_cond_destroy(&job.cond);
+		free(job.chunks);
+		free(threads);
+		return translate_mapped(map, size, out, NULL, cache, stats);
+	}
+
+	pthread_mutex_lock(&job.lock);
+	while (job.written < job.nr_chunks && !job.failed)
+	{
+		struct chunk *chunk = &job.chunks[job.written];
+		uint64_t start;
+
+		if (!chunk->done)
+		{
+			pthread_cond_wait(&job.cond, &job.lock);
+			continue;
+		}
+		pthread_mutex_unlock(&job.lock);
+
+		start = stats ? monotonic_ns() : 0;
+		report_deferred(&chunk->out, out->reports, out->line_no);
+		out->line_no += chunk->out.line_no;
+		ret = output_bytes(out, chunk->out.buf, chunk->out.len);
+		free(chunk->out.buf);
+		chunk->out.buf = NULL;
+
+		pthread_mutex_lock(&job.lock);
+		if (stats)
+			stats->stage_ns[STAGE_OUTPUT] += monotonic_ns() - start;
+		if (ret < 0)
+			job.failed = true;
+		job.written++;
+		pthread_cond_broadcast(&job.cond);
+	}
+	if (job.failed)
+		ret = -1;
+	pthread_mutex_unlock(&job.lock);
+
+	for (int i = 0; i < nr_started; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	for (int i = 0; i < job.nr_chunks; i++)
+	{
+		if (i >= job.written)
+			free(job.chunks[i].out.buf);
+		free(job.chunks[i].out.failed);
+	}
+
+	if (cache)
+	{
+		cache->hits += job.hits;
+		cache->misses += job.misses;
+	}
+
+	pthread_mutex_destroy(&job.lock);
+	pthread_cond_destroy(&job.cond);
+	free(job.chunks);
+	free(threads);
+	return ret;
+}
+
+/***********************************************************************
+ * Parallel batch mode into a mapped output file (-j N -o FILE)
+ *
+ * Every word takes the same number of bytes, so once the words are counted
+ * (one per line that is not blank) the place of every chunk's words in the
+ * output is known. The workers count the words of every chunk first; then
+ * the output file is sized and mapped, and each worker formats the words of
+ * its chunks straight into their regions of the file. Chunks are taken in
+ * any order and nothing is stitched together afterwards.
+ */
+struct fixed_job
+{
+	struct chunk *chunks; /* out.cap and out.line_no hold a chunk's size and lines once counted */
+	int nr_chunks;
+	atomic_int next; /* next chunk to take */
+	atomic_bool failed;
+	bool counting; /* first pass */
+	int word_len;
+	bool cached;
+	uint64_t hits, misses;
+	struct stats *stats; /* workers add theirs here */
+	pthread_mutex_t lock;
+};
+
+static void *fixed_worker(void *arg)
+{
+	struct fixed_job *job = arg;
+	struct mipsasm_cache *cache = NULL;
+	struct stats stats = {0};
+	int i;
+
+	if (!job->counting && job->cached && (cache = malloc(sizeof(*cache))))
+		mipsasm_cache_init(cache);
+
+	while ((i = atomic_fetch_add(&job->next, 1)) < job->nr_chunks && !atomic_load(&job->failed))
+	{
+		struct chunk *chunk = &job->chunks[i];
+
+		if (job->counting)
+		{
+			uint64_t start = job->stats ? monotonic_ns() : 0;
+			struct line_index index;
+
+			index_lines(chunk->start, chunk->len, &index, false);
+			chunk->out.cap = index.nr_words * job->word_len;
+			chunk->out.line_no = index.nr_lines;
+			if (job->stats)
+				stats.stage_ns[STAGE_READ] += monotonic_ns() - start;
+		}
+		else if (translate_mapped(chunk->start, chunk->len, &chunk->out, NULL, cache, job->stats ? &stats : NULL) < 0 ||
+				 chunk->out.len != chunk->out.cap)
+		{
+			atomic_store(&job->failed, true);
+		}
+	}
+
+	pthread_mutex_lock(&job->lock);
+	if (cache)
+	{
+		job->hits += cache->hits;
+		job->misses += cache->misses;
+	}
+	if (job->stats)
+		stats_add(job->stats, &stats);
+	pthread_mutex_unlock(&job->lock);
+
+	free(cache);
+	return NULL;
+}
+
+/* Run fixed_worker() on @nr_threads threads, or on this one if none start */
+static void run_fixed_workers(struct fixed_job *job, pthread_t *threads, int nr_threads)
+{
+	int nr_started = 0;
+
+	atomic_store(&job->next, 0);
+	for (int i = 0; i < nr_threads; i++)
+	{
+		if (pthread_create(&threads[i], NULL, fixed_worker, job) != 0)
+			break;
+		nr_started++;
+	}
+	if (nr_started == 0)
+		fixed_worker(job);
+	for (int i = 0; i < nr_started; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+}
+
+/* Whether @fd is an empty regular file, open for reading and writing */
+static bool output_mappable(int fd)
+{
+	struct stat st;
+	int flags = fcntl(fd, F_GETFL);
+
+	return flags >= 0 && (flags & O_ACCMODE) == O_RDWR && !(flags & O_APPEND) && fstat(fd, &st) == 0 &&
+		   S_ISREG(st.st_mode) && st.st_size == 0 && lseek(fd, 0, SEEK_CUR) == 0;
+}
+
+/*
+ * @out must be output_mappable(). If it cannot be sized or mapped, the
+ * words go through translate_parallel() instead.
+ */
+static int translate_fixed(const char *map, size_t size, int nr_threads, struct output *out,
+						   struct mipsasm_cache *cache, struct stats *stats)
+{
+	struct fixed_job job = {.word_len = WORD_LEN(out->format), .cached = cache != NULL, .stats = stats};
+	pthread_t *threads = calloc(nr_threads, sizeof(*threads));
+	size_t total = 0;
+	char *map_out = MAP_FAILED;
+	int ret = -1;
+
+	job.chunks = split_chunks(map, size, &job.nr_chunks);
+	if (!job.chunks || !threads)
+		goto out;
+	pthread_mutex_init(&job.lock, NULL);
+
+	job.counting = true;
+	run_fixed_workers(&job, threads, nr_threads);
+	for (int i = 0; i < job.nr_chunks; i++)
+	{
+		total += job.chunks[i].out.cap;
+	}
+
+	if (total > 0)
+	{
+		if (ftruncate(out->fd, total) < 0 ||
+			(map_out = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, out->fd, 0)) == MAP_FAILED)
+		{
+			pthread_mutex_destroy(&job.lock);
+			free(job.chunks);
+			free(threads);
+			if (ftruncate(out->fd, 0) < 0)
+				return -1;
+			return translate_parallel(map, size, nr_threads, out, cache, stats);
+		}
+	}
+
+	for (size_t i = 0, offset = 0; i < (size_t)job.nr_chunks; offset += job.chunks[i++].out.cap)
+	{
+		uint64_t nr_lines = job.chunks[i].out.line_no;
+
+		/* Numbered on from the line before the chunk */
+		job.chunks[i].out.line_no = out->line_no;
+		out->line_no += nr_lines;
+		job.chunks[i].out.fd = OUTPUT_FIXED;
+		job.chunks[i].out.format = out->format;
+		job.chunks[i].out.reports = out->reports;
+		job.chunks[i].out.buf = map_out + offset;
+	}
+	job.counting = false;
+	run_fixed_workers(&job, threads, nr_threads);
+
+	if (map_out != MAP_FAILED)
+	{
+		uint64_t start = stats ? monotonic_ns() : 0;
+
+		if (munmap(map_out, total) < 0)
+			atomic_store(&job.failed, true);
+		if (stats)
+			stats->stage_ns[STAGE_OUTPUT] += monotonic_ns() - start;
+	}
+	if (lseek(out->fd, total, SEEK_SET) < 0)
+		atomic_store(&job.failed, true);
+	out->bytes += total;
+	ret = atomic_load(&job.failed) ? -1 : 0;
+
+	if (cache)
+	{
+		cache->hits += job.hits;
+		cache->misses += job.misses;
+	}
+	pthread_mutex_destroy(&job.lock);
+out:
+	free(job.chunks);
+	free(threads);
+	return ret;
+}
+
+/***********************************************************************
+ * Random access (--lines RANGES)
+ *
+ * Only the lines in RANGES are translated. They are found through the
+ * marks of a line index, which is kept next to the source in FILE.idx so
+ * that the source is scanned once, not on every run. The index records the
+ * size and mtime of the source it was made of; one that does not match, or
+ * cannot be read, is made again. A source that cannot have an index
+ * written next to it just gets one in memory.
+ *
+ *   FILE.idx: LINE_INDEX_MAGIC, then the u64 fields of struct index_header,
+ *             then @nr_marks u64 offsets, all in host byte order
+ */
+#define LINE_INDEX_MAGIC "pa1-idx1"
+
+struct index_header
+{
+	char magic[8];
+	uint64_t size;
+	int64_t mtime_sec, mtime_nsec;
+	uint64_t stride;
+	uint64_t nr_lines, nr_words, nr_marks;
+};
+
+/* Lines @first to @last, from 1 */
+struct line_range
+{
+	size_t first, last;
+};
+
+/*
+ * Parse "A-B,C,D-E,..." into a new array of @nr_ranges ranges. Return NULL
+ * if @arg is malformed or out of memory.
+ */
+static struct line_range *parse_ranges(const char *arg, int *nr_ranges)
+{
+	struct line_range *ranges = NULL;
+
+	*nr_ranges = 0;
+	while (*arg)
+	{
+		struct line_range range, *grown;
+		char *end;
+
+		if (!isdigit((unsigned char)*arg))
+			goto malformed;
+		range.first = range.last = strtoull(arg, &end, 10);
+		if (*end == '-')
+		{
+			if (!isdigit((unsigned char)end[1]))
+				goto malformed;
+			range.last = strtoull(end + 1, &end, 10);
+		}
+		if (range.first < 1 || range.last < range.first || (*end && (*end != ',' || !end[1])))
+			goto malformed;
+		arg = *end ? end + 1 : end;
+
+		if (!(grown = realloc(ranges, (*nr_ranges + 1) * sizeof(*ranges))))
+			goto malformed;
+		ranges = grown;
+		ranges[(*nr_ranges)++] = range;
+	}
+	if (*nr_ranges > 0)
+		return ranges;
+
+malformed:
+	free(ranges);
+	return NULL;
+}
+
+static void index_header_init(struct index_header *header, const struct stat *st)
+{
+	*header = (struct index_header){.size = st->st_size};
+	memcpy(header->magic, LINE_INDEX_MAGIC, sizeof(header->magic));
+#ifdef __APPLE__
+	header->mtime_sec = st->st_mtimespec.tv_sec;
+	header->mtime_nsec = st->st_mtimespec.tv_nsec;
+#else
+	header->mtime_sec = st->st_mtim.tv_sec;
+	header->mtime_nsec = st->st_mtim.tv_nsec;
+#endif
+	header->stride = LINE_INDEX_STRIDE;
+}
+
+/*
+ * Load the index of the source @st from @path; -1 if it is missing, stale
+ * or has marks that cannot be line starts of the source
+ */
+static int load_index(const char *path, const struct stat *st, struct line_index *index)
+{
+	struct index_header expected, header;
+	struct stat index_st;
+	int fd = open(path, O_RDONLY);
+	size_t len;
+
+	if (fd < 0)
+		return -1;
+	index_header_init(&expected, st);
+	*index = (struct line_index){0};
+	if (read(fd, &header, sizeof(header)) != sizeof(header) ||
+		memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.size != expected.size ||
+		header.mtime_sec != expected.mtime_sec || header.mtime_nsec != expected.mtime_nsec ||
+		header.stride != expected.stride)
+		goto stale;
+
+	len = header.nr_marks * sizeof(*index->marks);
+	if (header.nr_marks != (header.nr_lines + LINE_INDEX_STRIDE - 1) / LINE_INDEX_STRIDE || fstat(fd, &index_st) < 0 ||
+		(uint64_t)index_st.st_size != sizeof(header) + len)
+		goto stale;
+	if (header.nr_lines == 0 || !(index->marks = malloc(len)) || read(fd, index->marks, len) != (ssize_t)len)
+		goto stale;
+	for (size_t i = 0; i < header.nr_marks; i++)
+	{
+		if (index->marks[i] >= header.size || (i == 0 ? index->marks[i] != 0 : index->marks[i] <= index->marks[i - 1]))
+			goto stale;
+	}
+	index->nr_lines = header.nr_lines;
+	index->nr_words = header.nr_words;
+	index->nr_marks = index->cap = header.nr_marks;
+	close(fd);
+	return 0;
+
+stale:
+	free(index->marks);
+	index->marks = NULL;
+	close(fd);
+	return -1;
+}
+
+/* Write @index of the source @st to @path, through a rename */
+static int save_index(const char *path, const struct stat *st, const struct line_index *index)
+{
+	struct index_header header;
+	size_t len = index->nr_marks * sizeof(*index->marks);
+	char *tmp = malloc(strlen(path) + sizeof(".tmp"));
+	int fd, ret = -1;
+
+	if (!tmp)
+		return -1;
+	sprintf(tmp, "%s.tmp", path);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		goto out;
+
+	index_header_init(&header, st);
+	header.nr_lines = index->nr_lines;
+	header.nr_words = index->nr_words;
+	header.nr_marks = index->nr_marks;
+	if (write(fd, &header, sizeof(header)) == sizeof(header) && write(fd, index->marks, len) == (ssize_t)len)
+		ret = 0;
+	if (close(fd) < 0 || ret < 0 || rename(tmp, path) < 0)
+	{
+		unlink(tmp);
+		ret = -1;
+	}
+out:
+	free(tmp);
+	return ret;
+}
+
+/*
+ * Translate @ranges of the @st.st_size bytes of @path mapped at @map.
+ * Return -2 if a range is past the last line or the index cannot be made,
+ * -1 on write errors.
+ */
+static int translate_lines(const char *path, const char *map, const struct stat *st, const struct line_range *ranges,
+						   int nr_ranges, struct output *out, struct mipsasm_cache *cache, struct stats *stats)
+{
+	char *index_path = malloc(strlen(path) + sizeof(".idx"));
+	struct line_index index = {0};
+	size_t size = map ? st->st_size : 0;
+	uint64_t start = stats ? monotonic_ns() : 0;
+	int ret = 0;
+
+	if (!index_path)
+		return -2;
+	sprintf(index_path, "%s.idx", path);
+	if (size > 0 && load_index(index_path, st, &index) < 0)
+	{
+		if (index_lines(map, size, &index, true) < 0)
+		{
+			free(index_path);
+			return -2;
+		}
+		save_index(index_path, st, &index);
+	}
+	free(index_path);
+	if (stats)
+		stats->stage_ns[STAGE_READ] += monotonic_ns() - start;
+
+	for (int i = 0; i < nr_ranges; i++)
+	{
+		if (ranges[i].last > index.nr_lines)
+		{
+			fprintf(stderr, "%s has %zu lines, not %zu\n", path, index.nr_lines, ranges[i].last);
+			ret = -2;
+			goto out;
+		}
+	}
+	for (int i = 0; i < nr_ranges && ret == 0; i++)
+	{
+		const char *first = index_seek(&index, map, size, ranges[i].first - 1);
+		const char *end = ranges[i].last < index.nr_lines ? index_seek(&index, map, size, ranges[i].last) : map + size;
+
+		out->line_no = ranges[i].first - 1;
+		ret = translate_mapped(first, end - first, out, NULL, cache, stats);
+	}
+out:
+	free(index.marks);
+	return ret;
+}
+
+/***********************************************************************
+ * Incremental mode (--incremental CACHE)
+ *
+ * CACHE keeps the word and status of every line of the last run, keyed by
+ * a 64-bit hash of the line. Lines whose hash is found reuse the result;
+ * only the others are translated. Entries of lines that are gone are
+ * dropped when CACHE is written back, so it follows the source instead of
+ * growing with every edit. Two different lines that hash alike would share
+ * a word; with 64 bits that is unlikely for any source pa1 will see.
+ *
+ * CACHE also records the ns per line of the last run that translated
+ * every line, which is what the saved time is reckoned against.
+ *
+ *   CACHE: WORD_CACHE_MAGIC, u64 nr_entries, u64 ns_per_line, then
+ *          @nr_entries struct word_entry, all in host byte order
+ */
+#define WORD_CACHE_MAGIC "pa1-inc1"
+
+struct word_entry
+{
+	uint64_t hash; /* 0 for free entries */
+	uint32_t word;
+	uint8_t status;
+	bool seen; /* the line is in this run's source */
+	bool fresh; /* and was not in the last one's */
+};
+
+struct word_cache
+{
+	struct word_entry *entries;
+	size_t mask;
+	size_t nr_entries;
+	uint64_t ns_per_line; /* of a full run, 0 if unknown */
+	size_t nr_loaded;
+	uint64_t lines, recomputed;
+};
+
+/* Never 0, which marks free entries */
+static inline uint64_t hash_line(const char *line, size_t len)
+{
+	uint64_t h = len * 0x9e3779b97f4a7c15ull, v;
+
+	for (; len >= 8; line += 8, len -= 8)
+	{
+		memcpy(&v, line, 8);
+		h = (h ^ v) * 0xbf58476d1ce4e5b9ull;
+		h ^= h >> 29;
+	}
+	if (len > 0)
+	{
+		v = 0;
+		memcpy(&v, line, len);
+		h = (h ^ v) * 0xbf58476d1ce4e5b9ull;
+	}
+	h = (h ^ (h >> 30)) * 0x94d049bb133111ebull;
+	h ^= h >> 31;
+	return h ? h : 1;
+}
+
+/* The entry of @hash, or the free one it goes into */
+static inline struct word_entry *word_cache_find(struct word_cache *wc, uint64_t hash)
+{
+	size_t i = hash & wc->mask;
+
+	while (wc->entries[i].hash && wc->entries[i].hash != hash)
+		i = (i + 1) & wc->mask;
+	return &wc->entries[i];
+}
+
+/* Make room for @nr_entries at half load at most */
+static int word_cache_reserve(struct word_cache *wc, size_t nr_entries)
+{
+	struct word_cache grown = *wc;
+	size_t cap = 1024;
+
+	if (nr_entries > SIZE_MAX / 2 / sizeof(*wc->entries))
+		return -1;
+	while (cap < 2 * nr_entries)
+		cap *= 2;
+	if (wc->entries && cap <= wc->mask + 1)
+		return 0;
+
+	grown.mask = cap - 1;
+	if (!(grown.entries = calloc(cap, sizeof(*grown.entries))))
+		return -1;
+	for (size_t i = 0; wc->entries && i <= wc->mask; i++)
+	{
+		if (wc->entries[i].hash)
+			*word_cache_find(&grown, wc->entries[i].hash) = wc->entries[i];
+	}
+	free(wc->entries);
+	*wc = grown;
+	return 0;
+}
+
+#define WORD_CACHE_HEADER_LEN (8 + 2 * sizeof(uint64_t))
+
+/*
+ * Load @path into @wc. A missing CACHE, or one that is not exactly what
+ * word_cache_save() writes, leaves @wc empty.
+ */
+static int word_cache_load(const char *path, struct word_cache *wc)
+{
+	static struct word_entry entries[BATCH_LINES];
+	size_t nr_read;
+	char magic[8];
+	uint64_t header[2];
+	struct stat st;
+	FILE *file;
+
+	*wc = (struct word_cache){0};
+	if (word_cache_reserve(wc, 0) < 0)
+		return -1;
+	if (!(file = fopen(path, "rb")))
+		return 0;
+	if (fstat(fileno(file), &st) < 0 || st.st_size < (off_t)WORD_CACHE_HEADER_LEN ||
+		(st.st_size - WORD_CACHE_HEADER_LEN) % sizeof(struct word_entry) != 0 ||
+		fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, WORD_CACHE_MAGIC, sizeof(magic)) != 0 ||
+		fread(header, sizeof(header), 1, file) != 1 ||
+		header[0] != (st.st_size - WORD_CACHE_HEADER_LEN) / sizeof(struct word_entry) ||
+		word_cache_reserve(wc, header[0]) < 0)
+		goto out;
+
+	wc->ns_per_line = header[1];
+	while (wc->nr_entries < header[0] && (nr_read = fread(entries, sizeof(*entries), BATCH_LINES, file)) > 0)
+	{
+		for (size_t i = 0; i < nr_read; i++)
+			__builtin_prefetch(&wc->entries[entries[i].hash & wc->mask], 1);
+		for (size_t i = 0; i < nr_read && wc->nr_entries < header[0]; i++)
+		{
+			if (!entries[i].hash || entries[i].status >= NR_STATUS)
+				goto empty;
+			entries[i].seen = entries[i].fresh = false;
+			*word_cache_find(wc, entries[i].hash) = entries[i];
+			wc->nr_entries++;
+		}
+	}
+	if (wc->nr_entries == header[0])
+		goto out;
+
+empty:
+	memset(wc->entries, 0, (wc->mask + 1) * sizeof(*wc->entries));
+	wc->nr_entries = 0;
+	wc->ns_per_line = 0;
+out:
+	wc->nr_loaded = wc->nr_entries;
+	fclose(file);
+	return 0;
+}
+
+/* Write the entries of the lines seen in this run to @path, through a rename */
+static int word_cache_save(const char *path, const struct word_cache *wc)
+{
+	char *tmp = malloc(strlen(path) + sizeof(".tmp"));
+	uint64_t header[2] = {0, wc->ns_per_line};
+	FILE *file;
+	int ret = 0;
+
+	if (!tmp)
+		return -1;
+	sprintf(tmp, "%s.tmp", path);
+	if (!(file = fopen(tmp, "wb")))
+	{
+		free(tmp);
+		return -1;
+	}
+	for (size_t i = 0; i <= wc->mask; i++)
+		header[0] += wc->entries[i].seen;
+
+	if (fwrite(WORD_CACHE_MAGIC, 8, 1, file) != 1 || fwrite(header, sizeof(header), 1, file) != 1)
+		ret = -1;
+	for (size_t i = 0; i <= wc->mask && ret == 0; i++)
+	{
+		if (wc->entries[i].seen && fwrite(&wc->entries[i], sizeof(wc->entries[i]), 1, file) != 1)
+			ret = -1;
+	}
+	if (fclose(file) != 0 || ret < 0 || rename(tmp, path) < 0)
+	{
+		unlink(tmp);
+		ret = -1;
+	}
+	free(tmp);
+	return ret;
+}
+
+/*
+ * Report the lines not in the last run, and the time saved against the last run
+ * that started without results; a run that did becomes the one to compare
+ * with.
+ */
+static void incremental_report(FILE *file, struct word_cache *wc, uint64_t ns)
+{
+	fprintf(file, "incremental: %" PRIu64 " lines, %" PRIu64 " recomputed, %.1f ms", wc->lines, wc->recomputed,
+			ns / 1e6);
+	if (wc->lines > 0 && wc->nr_loaded == 0)
+	{
+		wc->ns_per_line = ns / wc->lines;
+		fprintf(file, ", a full run\n");
+	}
+	else if (wc->ns_per_line)
+	{
+		fprintf(file, ", %.1f ms saved\n", ((double)wc->ns_per_line * wc->lines - ns) / 1e6);
+	}
+	else
+	{
+		fprintf(file, "\n");
+	}
+}
+
+/*
+ * Like translate_mapped(), reusing the results in @wc and adding the new
+ * ones. A large source has a table far larger than the CPU caches, so the
+ * lines of a batch are all hashed and their entries prefetched before the
+ * first one is looked at.
+ */
+static int translate_incremental(const char *map, size_t size, struct output *out, struct word_cache *wc,
+								 struct mipsasm_cache *cache, struct stats *stats)
+{
+	uint32_t words[BATCH_LINES];
+	uint8_t status[BATCH_LINES];
+	uint64_t hashes[BATCH_LINES];
+	size_t lens[BATCH_LINES];
+	const char *end = map + size;
+
+	while (map < end)
+	{
+		uint64_t start = stats ? monotonic_ns() : 0, translated = 0;
+		const char *batch = map, *line = map;
+		size_t nr_lines = 0;
+
+		if (word_cache_reserve(wc, wc->nr_entries + BATCH_LINES) < 0)
+			return -2;
+		for (; nr_lines < BATCH_LINES && map < end; nr_lines++)
+		{
+			const char *eol = memchr(map, '\n', end - map);
+
+			lens[nr_lines] = (eol ? eol : end) - map;
+			hashes[nr_lines] = hash_line(map, lens[nr_lines]);
+			__builtin_prefetch(&wc->entries[hashes[nr_lines] & wc->mask]);
+			map = eol ? eol + 1 : end;
+		}
+
+		for (size_t i = 0; i < nr_lines; i++)
+		{
+			struct word_entry *entry = word_cache_find(wc, hashes[i]);
+
+			if (!entry->hash)
+			{
+				entry->hash = hashes[i];
+				if (cache)
+					entry->status = mipsasm_translate_line_cached(cache, line, lens[i], &entry->word);
+				else
+					entry->status = mipsasm_translate_line(line, lens[i], &entry->word);
+				entry->fresh = true;
+				wc->nr_entries++;
+			}
+			entry->seen = true;
+			wc->recomputed += entry->fresh;
+			words[i] = entry->word;
+			status[i] = entry->status;
+			line += lens[i] + 1;
+		}
+		wc->lines += nr_lines;
+
+		if (stats)
+			translated = monotonic_ns();
+		for (size_t i = 0; i < nr_lines; i++)
+		{
+			if (output_line(out, status[i], words[i]) < 0)
+				return -1;
+		}
+		if (stats)
+		{
+			stats->stage_ns[STAGE_TRANSLATE] += translated - start;
+			stats->stage_ns[STAGE_OUTPUT] += monotonic_ns() - translated;
+			stats->bytes_in += map - batch;
+			for (size_t i = 0; i < nr_lines; i++)
+				count_line(stats, status[i], words[i]);
+		}
+	}
+	return 0;
+}
+
+/***********************************************************************
+ * Streamed input
+ *
+ * Sources that cannot be mapped are read line by line with the reader, in
+ * one thread, when a person is typing. Otherwise they go through a
+ * three-stage pipeline: a reader thread reads the input into blocks cut at
+ * newlines, the calling thread translates each block into an output block
+ * with translate_mapped(), and a writer thread writes the output blocks in
+ * order. Blocks are handed over through single-producer single-consumer
+ * rings and come back through rings going the other way, so every block
+ * belongs to one stage at a time and no stage takes a lock. PIPE_BLOCKS
+ * blocks of each kind circulate, which lets reading, translating and
+ * writing overlap in fixed memory. A stage that finds its ring empty or
+ * full yields for a while and then backs off into short sleeps.
+ *
+ * Both return 0, or -1 if the output cannot be written and -2 if the
+ * input cannot be read, with errno set.
+ */
+#define READ_FAILED -2
+
+static int translate_stream(int fd, struct output *out, bool interactive, struct labels *labels,
+							struct mipsasm_cache *cache, struct stats *stats)
+{
+	struct reader reader = {.fd = fd, .cap = READER_BUFFER_SIZE};
+	uint64_t start = stats ? monotonic_ns() : 0;
+	const char *line;
+	size_t len;
+	int ret;
+
+	if (!(reader.buf = malloc(reader.cap)))
+		return READ_FAILED;
+
+	/* The prompt has no newline, and nothing reads stdin through stdio */
+	if (interactive)
+		fflush(stdout);
+	while ((ret = reader_next(&reader, &line, &len)) > 0)
+	{
+		if (stats)
+			stats->stage_ns[STAGE_READ] += monotonic_ns() - start;
+		if (translate_line(line, len, out, labels, cache, stats) < 0 ||
+			(interactive && output_flush(out) < 0))
+		{
+			free(reader.buf);
+			return -1;
+		}
+		/* Once per line, whether or not labels hold its word back */
+		if (out->prompt)
+			printf(">> ");
+		if (interactive)
+			fflush(stdout);
+		if (stats)
+			start = monotonic_ns();
+	}
+	free(reader.buf);
+	return ret < 0 ? READ_FAILED : 0;
+}
+
+#define PIPE_THREADS 3 /* counting the caller */
+#define PIPE_BLOCKS 8  /* power of two */
+#define PIPE_BLOCK_SIZE (1 << 18)
+
+struct ring
+{
+	_Alignas(64) atomic_size_t head; /* next slot to pop; moved by the consumer */
+	_Alignas(64) atomic_size_t tail; /* next slot to push; moved by the producer */
+	void *slots[PIPE_BLOCKS];
+};
+
+static bool ring_push(struct ring *ring, void *item)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == PIPE_BLOCKS)
+		return false;
+	ring->slots[tail & (PIPE_BLOCKS - 1)] = item;
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+static bool ring_pop(struct ring *ring, void **item)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
 
-typedef unsigned char bool;
-#define true 1
-#define false 0
-/*          ****** DO NOT MODIFY ANYTHING UP TO THIS LINE ******      */
-/*====================================================================*/
+	if (head == atomic_load_explicit(&ring->tail, memory_order_acquire))
+		return false;
+	*item = ring->slots[head & (PIPE_BLOCKS - 1)];
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+	return true;
+}
 
-/***********************************************************************
- * translate()
- *
- * DESCRIPTION
- *   Translate assembly represented in @tokens[] into a MIPS instruction.
- *   This translate should support following 13 assembly commands
- *
- *    - add
- *    - addi
- *    - sub
- *    - and
- *    - andi
- *    - or
- *    - ori
- *    - nor
- *    - lw
- *    - sw
- *    - sll
- *    - srl
- *    - sra
- *    - beq
- *    - bne
- *
- * RETURN VALUE
- *   Return a 32-bit MIPS instruction
- *
- */
+struct block
+{
+	size_t len;
+	size_t cap;
+	char *buf;
+};
+
+struct pipeline
+{
+	int fd;
+	struct output *out;
+	struct ring full_in, free_in;	/* reader -> translator, and back */
+	struct ring full_out, free_out; /* translator -> writer, and back */
+	struct block in[PIPE_BLOCKS];
+	struct output chunks[PIPE_BLOCKS];
+	struct stats *stats;			 /* NULL unless counting */
+	struct stats reader_stats, writer_stats;
+	atomic_int failed; /* -1 or READ_FAILED once a stage fails */
+	int error;		   /* errno of the failure */
+};
+
+static void pipeline_fail(struct pipeline *pipe, int failed)
+{
+	int expected = 0;
 
-typedef struct
+	if (atomic_compare_exchange_strong(&pipe->failed, &expected, failed))
+		pipe->error = errno;
+}
+
+static void backoff(unsigned int spins)
 {
-	int type;
-	int opcode;
-} InstructionInfo;
+	struct timespec ts = {0, 1000L << (spins < 74 ? spins - 64 : 10)}; // 1us up to 1ms
+
+	if (spins < 64)
+		sched_yield();
+	else
+		nanosleep(&ts, NULL);
+}
 
-/* table */
-const char *registers[32] = {
-		"zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
-		"t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
-		"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
-		"t8", "t9", "k1", "k2", "gp", "sp", "fp", "ra"};
+/* Give up, returning false, once some stage has failed */
+static bool pipeline_push(struct pipeline *pipe, struct ring *ring, void *item)
+{
+	for (unsigned int spins = 0; !ring_push(ring, item); spins++)
+	{
+		if (atomic_load(&pipe->failed))
+			return false;
+		backoff(spins);
+	}
+	return true;
+}
 
-/* R-format */
-const char *r_instructions[] = {"add", "sub", "and", "or", "nor"};
-int r_funct[] = {0x20, 0x22, 0x24, 0x25, 0x27};
+static bool pipeline_pop(struct pipeline *pipe, struct ring *ring, void **item)
+{
+	for (unsigned int spins = 0; !ring_pop(ring, item); spins++)
+	{
+		if (atomic_load(&pipe->failed))
+			return false;
+		backoff(spins);
+	}
+	return true;
+}
 
-/* R-Shift */
-const char *r_shift_instructions[] = {"sll", "srl", "sra"};
-int r_shift_funct[] = {0x00, 0x02, 0x03};
+static bool block_reserve(struct block *block, size_t cap)
+{
+	char *buf;
 
-/* I-format */
-const char *i_instructions[] = {"addi", "andi", "ori", "lw", "sw", "beq", "bne"};
-int i_opcodes[] = {0x08, 0x0c, 0x0d, 0x23, 0x2b, 0x04, 0x05};
+	if (block->cap >= cap)
+		return true;
+	if (!(buf = realloc(block->buf, cap)))
+		return false;
+	block->buf = buf;
+	block->cap = cap;
+	return true;
+}
 
-InstructionInfo detectType(const char *token)
+/*
+ * Read into a block and hand it over as soon as it holds a whole line;
+ * the partial line after the last newline moves to the next block. A NULL
+ * block marks the end of the input.
+ */
+static void *pipeline_reader(void *arg)
 {
-	InstructionInfo info;
-	info.type = -1; // 기본값
+	struct pipeline *pipe = arg;
+	struct block *block, *next;
+
+	if (!pipeline_pop(pipe, &pipe->free_in, (void **)&block))
+		return NULL;
+	block->len = 0;
 
-	for (int i = 0; i < 5; i++)
+	for (;;)
 	{
-		if (strcmp(token, r_instructions[i]) == 0)
+		uint64_t start = pipe->stats ? monotonic_ns() : 0;
+		size_t carry;
+		ssize_t ret;
+		char *eol;
+
+		if (block->len == block->cap && !block_reserve(block, block->cap * 2))
+			goto fail;
+		ret = read(pipe->fd, block->buf + block->len, block->cap - block->len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			goto fail;
+		if (pipe->stats)
+			pipe->reader_stats.stage_ns[STAGE_READ] += monotonic_ns() - start;
+		if (ret == 0)
+			break;
+
+		/* Only the bytes just read can hold a newline */
+		for (eol = block->buf + block->len + ret - 1; eol >= block->buf + block->len && *eol != '\n'; eol--)
+			;
+		if (eol < block->buf + block->len)
 		{
-			info.type = 0; // R-format
-			info.opcode = r_funct[i];
-			return info;
+			block->len += ret;
+			continue;
 		}
+		block->len += ret;
+
+		if (!pipeline_pop(pipe, &pipe->free_in, (void **)&next))
+			return NULL;
+		carry = block->buf + block->len - (eol + 1);
+		if (!block_reserve(next, carry))
+			goto fail;
+		memcpy(next->buf, eol + 1, carry);
+		next->len = carry;
+		block->len -= carry;
+		if (!pipeline_push(pipe, &pipe->full_in, block))
+			return NULL;
+		block = next;
 	}
 
-	for (int i = 0; i < 3; i++)
+	if (block->len > 0 && !pipeline_push(pipe, &pipe->full_in, block))
+		return NULL;
+	pipeline_push(pipe, &pipe->full_in, NULL);
+	return NULL;
+
+fail:
+	pipeline_fail(pipe, READ_FAILED);
+	return NULL;
+}
+
+/* Write the output blocks in order until the NULL one */
+static void *pipeline_writer(void *arg)
+{
+	struct pipeline *pipe = arg;
+	struct output *chunk;
+
+	while (pipeline_pop(pipe, &pipe->full_out, (void **)&chunk) && chunk)
 	{
-		if (strcmp(token, r_shift_instructions[i]) == 0)
+		uint64_t start = pipe->stats ? monotonic_ns() : 0;
+
+		if (output_bytes(pipe->out, chunk->buf, chunk->len) < 0)
 		{
-			info.type = 1; // R-format (Shift)
-			info.opcode = r_shift_funct[i];
-			return info;
+			pipeline_fail(pipe, -1);
+			break;
 		}
+		chunk->len = 0;
+		if (pipe->stats)
+			pipe->writer_stats.stage_ns[STAGE_OUTPUT] += monotonic_ns() - start;
+		if (!pipeline_push(pipe, &pipe->free_out, chunk))
+			break;
+	}
+	return NULL;
+}
+
+static int translate_pipelined(int fd, struct output *out, struct labels *labels, struct mipsasm_cache *cache,
+							   struct stats *stats)
+{
+	struct pipeline *pipe = calloc(1, sizeof(*pipe));
+	pthread_t reader, writer;
+	int ret;
+
+	if (!pipe)
+		return translate_stream(fd, out, false, labels, cache, stats);
+
+	pipe->fd = fd;
+	pipe->out = out;
+	pipe->stats = stats;
+	for (int i = 0; i < PIPE_BLOCKS; i++)
+	{
+		pipe->chunks[i].fd = OUTPUT_MEMORY;
+		pipe->chunks[i].format = out->format;
+		pipe->chunks[i].prompt = out->prompt;
+		pipe->chunks[i].reports = out->reports;
+		if (!block_reserve(&pipe->in[i], PIPE_BLOCK_SIZE))
+			goto fallback;
+		ring_push(&pipe->free_in, &pipe->in[i]);
+		ring_push(&pipe->free_out, &pipe->chunks[i]);
+	}
+
+	/* Nothing is read until both threads run, so the fallback sees all input */
+	if (pthread_create(&writer, NULL, pipeline_writer, pipe) != 0)
+		goto fallback;
+	if (pthread_create(&reader, NULL, pipeline_reader, pipe) != 0)
+	{
+		ring_push(&pipe->full_out, NULL);
+		pthread_join(writer, NULL);
+		goto fallback;
 	}
 
-	for (int i = 0; i < 7; i++)
+	for (;;)
 	{
-		if (strcmp(token, i_instructions[i]) == 0)
+		struct block *block;
+		struct output *chunk;
+
+		if (!pipeline_pop(pipe, &pipe->full_in, (void **)&block))
+			break;
+		if (!block)
+		{
+			pipeline_push(pipe, &pipe->full_out, NULL);
+			break;
+		}
+		if (!pipeline_pop(pipe, &pipe->free_out, (void **)&chunk))
+			break;
+		chunk->line_no = out->line_no;
+		if (translate_mapped(block->buf, block->len, chunk, labels, cache, stats) < 0)
 		{
-			info.type = 2; // I-format
-			info.opcode = i_opcodes[i];
-			return info;
+			pipeline_fail(pipe, -1);
+			break;
 		}
+		out->line_no = chunk->line_no;
+		if (!pipeline_push(pipe, &pipe->free_in, block) || !pipeline_push(pipe, &pipe->full_out, chunk))
+			break;
 	}
 
-	return info;
+	/* A stage stuck in read(2) or write(2) would keep a failed run alive */
+	if (atomic_load(&pipe->failed))
+	{
+		pthread_cancel(reader);
+		pthread_cancel(writer);
+	}
+	pthread_join(reader, NULL);
+	pthread_join(writer, NULL);
+
+	ret = atomic_load(&pipe->failed);
+	if (ret)
+		errno = pipe->error;
+	if (stats)
+	{
+		stats_add(stats, &pipe->reader_stats);
+		stats_add(stats, &pipe->writer_stats);
+	}
+	for (int i = 0; i < PIPE_BLOCKS; i++)
+	{
+		free(pipe->in[i].buf);
+		free(pipe->chunks[i].buf);
+	}
+	free(pipe);
+	return ret;
+
+fallback:
+	for (int i = 0; i < PIPE_BLOCKS; i++)
+		free(pipe->in[i].buf);
+	free(pipe);
+	return translate_stream(fd, out, false, labels, cache, stats);
+}
+
+/***********************************************************************
+ * Daemon mode (--serve SOCKET, Linux only)
+ *
+ * pa1 stays resident and translates requests from clients on a Unix
+ * domain socket, framed as serve.h describes. The calling thread runs an
+ * epoll loop that accepts connections and reads requests into a buffer per
+ * connection. A connection holding a whole request is queued to a pool of
+ * -j N workers (one per CPU by default), which answer every whole request
+ * buffered on it and then hand it back to the loop. Connections are
+ * registered with EPOLLONESHOT, so each one belongs to a single thread at
+ * a time. SIGINT and SIGTERM stop the server and remove the socket.
+ */
+#ifdef __linux__
+#define SERVE_BUFFER_SIZE (1 << 16)
+#define SERVE_EVENTS 64
+
+struct connection
+{
+	int fd;
+	size_t len; /* bytes buffered */
+	size_t cap;
+	char *buf;
+	struct connection *next; /* in the work queue */
+};
+
+struct server
+{
+	int epoll_fd;
+	bool cached;
+	bool stopping;
+	struct connection *head, *tail; /* work queue */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static volatile sig_atomic_t serve_stop;
+
+static void serve_signal(int sig)
+{
+	(void)sig;
+	serve_stop = 1;
+}
+
+/* Closing the socket also takes it out of the epoll set */
+static void connection_close(struct connection *conn)
+{
+	close(conn->fd);
+	free(conn->buf);
+	free(conn);
+}
+
+/* Wait for the next request on @conn in the event loop */
+static int connection_arm(struct server *server, struct connection *conn, int op)
+{
+	struct epoll_event event = {.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT, .data.ptr = conn};
+
+	return epoll_ctl(server->epoll_fd, op, conn->fd, &event);
+}
+
+/* Length of the first request buffered on @conn, header included, or 0 */
+static size_t connection_request(const struct connection *conn)
+{
+	size_t len;
+
+	if (conn->len < SERVE_HEADER_LEN)
+		return 0;
+	len = SERVE_HEADER_LEN + (size_t)get_be32((const unsigned char *)conn->buf);
+	return conn->len >= len ? len : 0;
 }
 
-const int getRegisterNum(const char *token)
+static int send_all(int fd, const char *buf, size_t len)
 {
-	for (int i = 0; i < 32; i++)
+	while (len > 0)
 	{
-		if (strcmp(token, registers[i]) == 0)
+		ssize_t ret = send(fd, buf, len, MSG_NOSIGNAL);
+
+		if (ret < 0)
 		{
-			return i;
+			struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+
+			if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+				return -1;
+			if (errno != EINTR && poll(&pfd, 1, -1) < 0 && errno != EINTR)
+				return -1;
+			continue;
 		}
+		buf += ret;
+		len -= ret;
 	}
 	return 0;
 }
 
-static unsigned int translate(int nr_tokens, char *tokens[])
+/*
+ * Translate the @len bytes of lines at @lines and send the response. The
+ * response is built in *@resp, which grows as needed and is kept for the
+ * next request; the words are translated in place and then byte-swapped.
+ */
+static int serve_request(int fd, const char *lines, size_t len, struct mipsasm_cache *cache, char **resp,
+						 size_t *resp_cap)
 {
-	unsigned int code = 0;
-	InstructionInfo instructionInfo = detectType(tokens[0]);
-	switch (instructionInfo.type)
+	const char *curr = lines, *end = lines + len;
+	size_t nr_lines = 0, size, consumed;
+	unsigned char *header;
+	uint32_t *words;
+
+	while (curr < end)
 	{
-	case 0: // R-format (not Shift)
+		const char *eol = memchr(curr, '\n', end - curr);
+
+		curr = eol ? eol + 1 : end;
+		nr_lines++;
+	}
+
+	size = SERVE_HEADER_LEN + nr_lines * (sizeof(uint32_t) + 1);
+	if (size > *resp_cap)
 	{
-		int rd = getRegisterNum(tokens[1]);
-		int rs = getRegisterNum(tokens[2]);
-		int rt = getRegisterNum(tokens[3]);
-		code = (instructionInfo.opcode << 0) | (rd << 11) | (rt << 16) | (rs << 21);
-		break;
+		char *buf = realloc(*resp, size);
+
+		if (!buf)
+			return -1;
+		*resp = buf;
+		*resp_cap = size;
 	}
-	case 1: // R-format (Shift)
+	header = (unsigned char *)*resp;
+	words = (uint32_t *)(*resp + SERVE_HEADER_LEN);
+
+	mipsasm_translate_buffer(lines, len, words, (uint8_t *)(words + nr_lines), nr_lines, &consumed, cache);
+	put_be32(header, nr_lines);
+	for (size_t i = 0; i < nr_lines; i++)
 	{
-		int rd = getRegisterNum(tokens[1]);
-		int rt = getRegisterNum(tokens[2]);
-		int shamt = (int)strtol(tokens[3], NULL, 0);
-		code = (instructionInfo.opcode << 0) | (shamt << 6) | (rd << 11) | (rt << 16);
-		break;
+		put_be32((unsigned char *)&words[i], words[i]);
 	}
-	case 2: // I-format
+	return send_all(fd, *resp, size);
+}
+
+static void *serve_worker(void *arg)
+{
+	struct server *server = arg;
+	struct mipsasm_cache *cache = NULL;
+	char *resp = NULL;
+	size_t resp_cap = 0;
+
+	/* As with -j, a worker that cannot get a cache runs without one */
+	if (server->cached && (cache = malloc(sizeof(*cache))))
+		mipsasm_cache_init(cache);
+
+	for (;;)
 	{
-		int immediate, rt, rs = 0;
-		if (instructionInfo.opcode == 0x23 || instructionInfo.opcode == 0x2b) // lw, sw
+		struct connection *conn;
+		size_t len;
+		bool failed = false;
+
+		pthread_mutex_lock(&server->lock);
+		while (!server->head && !server->stopping)
+			pthread_cond_wait(&server->cond, &server->lock);
+		conn = server->head;
+		if (conn && !(server->head = conn->next))
+			server->tail = NULL;
+		pthread_mutex_unlock(&server->lock);
+		if (!conn)
+			break;
+
+		while (!failed && (len = connection_request(conn)) > 0)
 		{
-			rt = getRegisterNum(tokens[1]);
-			rs = getRegisterNum(tokens[3]);
-			immediate = (int)strtol(tokens[2], NULL, 0);
+			failed = serve_request(conn->fd, conn->buf + SERVE_HEADER_LEN, len - SERVE_HEADER_LEN, cache,
+								   &resp, &resp_cap) < 0;
+			memmove(conn->buf, conn->buf + len, conn->len - len);
+			conn->len -= len;
 		}
-		else
+		if (failed || connection_arm(server, conn, EPOLL_CTL_MOD) < 0)
+			connection_close(conn);
+	}
+
+	free(resp);
+	free(cache);
+	return NULL;
+}
+
+/* Read what @conn has sent, and queue it once a whole request is in */
+static void serve_read(struct server *server, struct connection *conn)
+{
+	bool eof = false;
+
+	for (;;)
+	{
+		ssize_t ret;
+
+		if (conn->len == conn->cap)
 		{
-			rt = getRegisterNum(tokens[1]);
-			rs = getRegisterNum(tokens[2]);
-			immediate = (int)strtol(tokens[3], NULL, 0);
+			size_t cap = conn->cap ? conn->cap * 2 : SERVE_BUFFER_SIZE;
+			char *buf;
+
+			if (cap > 2 * (SERVE_HEADER_LEN + (size_t)SERVE_MAX_REQUEST) || !(buf = realloc(conn->buf, cap)))
+				goto close;
+			conn->buf = buf;
+			conn->cap = cap;
 		}
-		if (immediate < 0)
+		ret = read(conn->fd, conn->buf + conn->len, conn->cap - conn->len);
+		if (ret > 0)
 		{
-			immediate = (immediate & 0xFFFF);
+			conn->len += ret;
+			continue;
 		}
-
-		code = (immediate << 0) | (rt << 16) | (rs << 21) | (instructionInfo.opcode << 26);
-
+		if (ret == 0)
+			eof = true;
+		else if (errno == EINTR)
+			continue;
+		else if (errno != EAGAIN && errno != EWOULDBLOCK)
+			goto close;
 		break;
 	}
-	default:
-		printf("wrong command");
-		break;
+
+	if (conn->len >= SERVE_HEADER_LEN && get_be32((const unsigned char *)conn->buf) > SERVE_MAX_REQUEST)
+		goto close;
+
+	/* A client may shut down its side and still wait for the responses */
+	if (connection_request(conn))
+	{
+		pthread_mutex_lock(&server->lock);
+		conn->next = NULL;
+		if (server->tail)
+			server->tail->next = conn;
+		else
+			server->head = conn;
+		server->tail = conn;
+		pthread_cond_signal(&server->cond);
+		pthread_mutex_unlock(&server->lock);
+		return;
 	}
+	if (!eof && connection_arm(server, conn, EPOLL_CTL_MOD) == 0)
+		return;
 
-	return code;
+close:
+	connection_close(conn);
 }
 
-/***********************************************************************
- * parse_command()
- *
- * DESCRIPTION
- *   Parse @assembly, and put each assembly token into @tokens[] and the number
- *   of tokes into @nr_tokens. You may use this implemention or your own
- *   from PA0.
- *
- *   A assembly token is defined as a string without any whitespace (i.e., space
- *   and tab in this programming assignment). For exmaple,
- *     command = "  add t1   t2 s0 "
- *
- *   then, nr_tokens = 4, and tokens is
- *     tokens[0] = "add"
- *     tokens[1] = "t0"
- *     tokens[2] = "t1"
- *     tokens[3] = "s0"
- *
- *   You can assume that the characters in the input string are all lowercase
- *   for testing.
- *
- *
- * RETURN VALUE
- *   Return 0 after filling in @nr_tokens and @tokens[] properly
- *
- */
-static int parse_command(char *assembly, int *nr_tokens, char *tokens[])
+static void serve_accept(struct server *server, int listen_fd)
 {
-	char *curr = assembly;
-	int token_started = false;
-	*nr_tokens = 0;
-
-	while (*curr != '\0')
+	for (;;)
 	{
-		if (isspace(*curr))
+		struct connection *conn;
+		int fd = accept(listen_fd, NULL, NULL);
+
+		if (fd < 0)
 		{
-			*curr = '\0';
-			token_started = false;
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			return;
 		}
-		else
+		if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 || !(conn = calloc(1, sizeof(*conn))))
 		{
-			if (!token_started)
-			{
-				tokens[*nr_tokens] = curr;
-				*nr_tokens += 1;
-				token_started = true;
-			}
+			close(fd);
+			continue;
 		}
-		curr++;
+		conn->fd = fd;
+		if (connection_arm(server, conn, EPOLL_CTL_ADD) < 0)
+			connection_close(conn);
 	}
+}
 
-	return 0;
+static int serve(const char *path, int nr_workers, bool cached)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+	struct sigaction action = {.sa_handler = serve_signal};
+	struct server server = {.cached = cached};
+	struct stat st;
+	pthread_t *workers;
+	int listen_fd, nr_started = 0, err = 0;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	/* Take over the socket a previous server left behind, and nothing else */
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		listen(listen_fd, SOMAXCONN) < 0)
+	{
+		fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	workers = calloc(nr_workers, sizeof(*workers));
+	if (server.epoll_fd < 0 || !workers || epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) < 0)
+	{
+		fprintf(stderr, "Cannot start server: %s\n", strerror(errno));
+		unlink(path);
+		return -1;
+	}
+
+	pthread_mutex_init(&server.lock, NULL);
+	pthread_cond_init(&server.cond, NULL);
+	for (int i = 0; i < nr_workers; i++)
+	{
+		if ((err = pthread_create(&workers[i], NULL, serve_worker, &server)) != 0)
+			break;
+		nr_started++;
+	}
+	if (nr_started == 0)
+		fprintf(stderr, "Cannot start server: %s\n", strerror(err));
+
+	/* No SA_RESTART, so the signals also break epoll_wait() */
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	while (nr_started > 0 && !serve_stop)
+	{
+		struct epoll_event events[SERVE_EVENTS];
+		int nr_events = epoll_wait(server.epoll_fd, events, SERVE_EVENTS, -1);
+
+		if (nr_events < 0 && errno != EINTR)
+			break;
+		for (int i = 0; i < nr_events; i++)
+		{
+			if (events[i].data.ptr)
+				serve_read(&server, events[i].data.ptr);
+			else
+				serve_accept(&server, listen_fd);
+		}
+	}
+
+	pthread_mutex_lock(&server.lock);
+	server.stopping = true;
+	pthread_cond_broadcast(&server.cond);
+	pthread_mutex_unlock(&server.lock);
+	for (int i = 0; i < nr_started; i++)
+	{
+		pthread_join(workers[i], NULL);
+	}
+
+	close(listen_fd);
+	close(server.epoll_fd);
+	unlink(path);
+	pthread_mutex_destroy(&server.lock);
+	pthread_cond_destroy(&server.cond);
+	free(workers);
+	return nr_started > 0 ? 0 : -1;
+}
+#else
+static int serve(const char *path, int nr_workers, bool cached)
+{
+	(void)path;
+	(void)nr_workers;
+	(void)cached;
+	fprintf(stderr, "--serve is only supported on Linux\n");
+	return -1;
+}
+#endif
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-j N] [-o FILE | --stdout] [--format=text|bin] [--endian=big|little] [--cache] [--stats] [FILE]\n"
+					"       %s --lines A-B,C,... [-o FILE | --stdout] [--format=...] [--endian=...] [--cache] [--stats] FILE\n"
+					"       %s --incremental CACHE [-o FILE | --stdout] [--format=...] [--endian=...] [--cache] [--stats] FILE\n"
+					"       %s --serve SOCKET [-j N] [--cache]\n",
+			prog, prog, prog, prog);
 }
 
 /*====================================================================*/
@@ -254,20 +2608,172 @@ static int parse_command(char *assembly, int *nr_tokens, char *tokens[])
  */
 int main(int argc, char *const argv[])
 {
-	char assembly[MAX_ASSEMBLY] = {'\0'};
+	static const struct option options[] = {
+		{"output", required_argument, NULL, 'o'},
+		{"stdout", no_argument, NULL, 's'},
+		{"jobs", required_argument, NULL, 'j'},
+		{"format", required_argument, NULL, 'f'},
+		{"endian", required_argument, NULL, 'e'},
+		{"cache", no_argument, NULL, 'c'},
+		{"stats", no_argument, NULL, 'S'},
+		{"serve", required_argument, NULL, 'L'},
+		{"lines", required_argument, NULL, 'l'},
+		{"incremental", required_argument, NULL, 'I'},
+		{NULL, 0, NULL, 0},
+	};
 	FILE *input = stdin;
+	struct output out = {.fd = OUTPUT_STDERR};
+	struct mipsasm_cache *cache = NULL;
+	struct labels labels = {0};
+	struct stats stats = {0}, *counters = NULL;
+	uint64_t started = monotonic_ns();
+	char *map = MAP_FAILED;
+	struct stat st = {0};
+	bool interactive;
+	bool binary = false, little_endian = false;
+	const char *socket_path = NULL;
+	struct line_range *ranges = NULL;
+	int nr_ranges = 0;
+	const char *word_cache_path = NULL;
+	int nr_threads = 1;
+	bool threads_given = false;
+	int opt, ret;
+
+	while ((opt = getopt_long(argc, argv, "j:o:", options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'o':
+			/* Readable too, so that -j can map it */
+			out.fd = open(optarg, O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if (out.fd < 0)
+				out.fd = open(optarg, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (out.fd < 0)
+			{
+				fprintf(stderr, "Cannot open output file %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 's':
+			out.fd = STDOUT_FILENO;
+			break;
+		case 'j':
+			nr_threads = atoi(optarg);
+			threads_given = true;
+			if (nr_threads < 1)
+			{
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'f':
+			if (strcmp(optarg, "text") != 0 && strcmp(optarg, "bin") != 0)
+			{
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			binary = strcmp(optarg, "bin") == 0;
+			break;
+		case 'e':
+			if (strcmp(optarg, "big") != 0 && strcmp(optarg, "little") != 0)
+			{
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			little_endian = strcmp(optarg, "little") == 0;
+			break;
+		case 'c':
+			if (!cache && !(cache = malloc(sizeof(*cache))))
+			{
+				fprintf(stderr, "Out of memory\n");
+				return EXIT_FAILURE;
+			}
+			mipsasm_cache_init(cache);
+			break;
+		case 'S':
+			counters = &stats;
+			break;
+		case 'L':
+			socket_path = optarg;
+			break;
+		case 'l':
+			free(ranges);
+			if (!(ranges = parse_ranges(optarg, &nr_ranges)))
+			{
+				fprintf(stderr, "--lines takes A-B,C,... with lines from 1\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'I':
+			word_cache_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if ((ranges || word_cache_path) && (socket_path || optind >= argc || (ranges && word_cache_path)))
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (ranges || word_cache_path)
+		nr_threads = 1;
+
+	if (socket_path)
+	{
+		if (!threads_given)
+			nr_threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+		ret = serve(socket_path, nr_threads, cache != NULL);
+		free(cache);
+		return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	if (binary)
+	{
+		if (out.fd == OUTPUT_STDERR)
+		{
+			fprintf(stderr, "--format=bin needs -o FILE or --stdout\n");
+			return EXIT_FAILURE;
+		}
+		out.format = little_endian ? FORMAT_BIN_LITTLE : FORMAT_BIN_BIG;
+	}
+
+	if (out.fd >= 0)
+	{
+		out.cap = OUTPUT_BUFFER_SIZE;
+		out.buf = malloc(out.cap);
+		if (!out.buf)
+		{
+			fprintf(stderr, "Out of memory\n");
+			return EXIT_FAILURE;
+		}
+	}
 
-	if (argc > 1)
+	if (optind < argc)
 	{
-		input = fopen(argv[1], "r");
+		input = fopen(argv[optind], "r");
 		if (!input)
 		{
-			fprintf(stderr, "No input file %s\n", argv[0]);
+			fprintf(stderr, "No input file %s\n", argv[optind]);
 			return EXIT_FAILURE;
 		}
 	}
 
-	if (input == stdin)
+	if (input != stdin && fstat(fileno(input), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(input), 0);
+	}
+	stats.stage_ns[STAGE_READ] += monotonic_ns() - started;
+
+	/* A person is typing; do not hold words back in the buffer */
+	interactive = input == stdin && isatty(STDIN_FILENO);
+	out.prompt = input == stdin && out.fd != STDOUT_FILENO;
+	if (out.fd == STDOUT_FILENO)
+		out.reports = stderr;
+
+	if (out.prompt)
 	{
 		printf("*********************************************************\n");
 		printf("*          >> SCE212 MIPS translator  v0.10 <<          *\n");
@@ -284,30 +2790,117 @@ int main(int argc, char *const argv[])
 		printf(">> ");
 	}
 
-	while (fgets(assembly, sizeof(assembly), input))
+	if (ranges)
 	{
-		char *tokens[MAX_NR_TOKENS] = {NULL};
-		int nr_tokens = 0;
-		unsigned int instruction;
-
-		for (size_t i = 0; i < strlen(assembly); i++)
+		if (!S_ISREG(st.st_mode))
 		{
-			assembly[i] = tolower(assembly[i]);
+			fprintf(stderr, "--lines needs a regular file\n");
+			return EXIT_FAILURE;
 		}
+		ret = translate_lines(argv[optind], map != MAP_FAILED ? map : NULL, &st, ranges, nr_ranges, &out, cache,
+							  counters);
+		if (ret == -2)
+			return EXIT_FAILURE;
+		if (ret < 0)
+			goto write_error;
+		if (map != MAP_FAILED)
+			munmap(map, st.st_size);
+		free(ranges);
+	}
+	else if (word_cache_path)
+	{
+		struct word_cache wc;
+		uint64_t start = monotonic_ns();
 
-		if (parse_command(assembly, &nr_tokens, tokens) < 0)
-			continue;
-
-		instruction = translate(nr_tokens, tokens);
-
-		fprintf(stderr, "0x%08x\n", instruction);
+		if (!S_ISREG(st.st_mode))
+		{
+			fprintf(stderr, "--incremental needs a regular file\n");
+			return EXIT_FAILURE;
+		}
+		if (word_cache_load(word_cache_path, &wc) < 0)
+		{
+			fprintf(stderr, "Out of memory\n");
+			return EXIT_FAILURE;
+		}
+		ret = translate_incremental(map != MAP_FAILED ? map : NULL, map != MAP_FAILED ? st.st_size : 0, &out, &wc,
+									cache, counters);
+		if (ret == -2)
+		{
+			fprintf(stderr, "Out of memory\n");
+			return EXIT_FAILURE;
+		}
+		if (ret < 0)
+			goto write_error;
+		incremental_report(out.fd == OUTPUT_STDERR ? stdout : stderr, &wc, monotonic_ns() - start);
+		if (word_cache_save(word_cache_path, &wc) < 0)
+			fprintf(stderr, "Cannot save %s: %s\n", word_cache_path, strerror(errno));
+		if (map != MAP_FAILED)
+			munmap(map, st.st_size);
+		free(wc.entries);
+	}
+	else if (map != MAP_FAILED)
+	{
+		/* Labels need the lines in order */
+		if (nr_threads > 1 && defines_labels(map, st.st_size))
+			nr_threads = 1;
 
-		if (input == stdin)
-			printf(">> ");
+		if (nr_threads > 1 && out.fd >= 0 && output_mappable(out.fd))
+			ret = translate_fixed(map, st.st_size, nr_threads, &out, cache, counters);
+		else if (nr_threads > 1)
+			ret = translate_parallel(map, st.st_size, nr_threads, &out, cache, counters);
+		else
+			ret = translate_mapped(map, st.st_size, &out, &labels, cache, counters);
+		if (ret < 0 || labels_finish(&labels, &out) < 0)
+			goto write_error;
+		munmap(map, st.st_size);
+	}
+	else
+	{
+		if (interactive)
+			ret = translate_stream(fileno(input), &out, true, &labels, cache, counters);
+		else
+			ret = translate_pipelined(fileno(input), &out, &labels, cache, counters);
+		if (ret == READ_FAILED)
+		{
+			fprintf(stderr, "Cannot read input: %s\n", strerror(errno));
+			return EXIT_FAILURE;
+		}
+		if (ret < 0 || labels_finish(&labels, &out) < 0)
+			goto write_error;
 	}
+	labels_free(&labels);
 
 	if (input != stdin)
 		fclose(input);
 
+	if (out.fd >= 0)
+	{
+		if (output_flush(&out) < 0)
+			goto write_error;
+		if (out.fd != STDOUT_FILENO)
+			close(out.fd);
+		free(out.buf);
+	}
+
+	/* Keep the reports off the stream that carries the words */
+	if (counters)
+		stats_report(out.fd == OUTPUT_STDERR ? stdout : stderr, &stats, out.bytes,
+					 map != MAP_FAILED ? nr_threads : interactive ? 1 : PIPE_THREADS, monotonic_ns() - started,
+					 cache);
+
+	if (cache)
+	{
+		uint64_t lookups = cache->hits + cache->misses;
+
+		fprintf(out.fd == OUTPUT_STDERR ? stdout : stderr,
+				"cache: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit rate)\n",
+				cache->hits, cache->misses, lookups ? 100.0 * cache->hits / lookups : 0.0);
+		free(cache);
+	}
+
 	return EXIT_SUCCESS;
+
+write_error:
+	fprintf(stderr, "Cannot write output: %s\n", strerror(errno));
+	return EXIT_FAILURE;
 }
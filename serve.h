@@ -0,0 +1,50 @@
+/**********************************************************************
+ * Copyright (c) 2021-2023
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/***********************************************************************
+ * Framing of pa1 --serve
+ *
+ *   A client sends any number of requests over one connection, and gets
+ *   one response per request, in order. All integers are big-endian.
+ *
+ *   request:  u32 length, then @length bytes of '\n'-separated lines
+ *   response: u32 nr_lines, then @nr_lines u32 words, then @nr_lines u8
+ *             mipsasm_status, one of each per line, blank lines included
+ *
+ *   A last line without '\n' counts as a line, as everywhere else. The
+ *   server closes connections that send requests over SERVE_MAX_REQUEST.
+ */
+#ifndef __SERVE_H__
+#define __SERVE_H__
+
+#include <stdint.h>
+
+#define SERVE_MAX_REQUEST (64u << 20)
+#define SERVE_HEADER_LEN 4
+
+static inline void put_be32(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static inline uint32_t get_be32(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+#endif
@@ -0,0 +1,79 @@
+/**********************************************************************
+ * Copyright (c) 2021-2023
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/***********************************************************************
+ * Whitespace a block at a time
+ *
+ *   Shared by the tokenizer in mipsasm.c and the line index in pa1.c, so
+ *   that both agree on which lines are blank. whitespace_mask() returns
+ *   one bit per byte of a WS_BLOCK-byte block, set for the bytes isspace()
+ *   accepts in the C locale (space and '\t' through '\r'), and
+ *   newline_mask() one bit per '\n'. All WS_BLOCK bytes are loaded.
+ *
+ *   WS_BLOCK is left undefined without SSE2, and the callers fall back to
+ *   isspace() a byte at a time.
+ */
+#ifndef __WHITESPACE_H__
+#define __WHITESPACE_H__
+
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WS_BLOCK 32
+
+static inline uint32_t whitespace_mask(const char *block)
+{
+	__m256i c = _mm256_loadu_si256((const __m256i *)block);
+	__m256i space = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(' '));
+	__m256i ctrl = _mm256_sub_epi8(c, _mm256_set1_epi8('\t'));
+
+	ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(ctrl, _mm256_set1_epi8('\r' - '\t')), ctrl);
+	return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(space, ctrl));
+}
+
+static inline uint32_t newline_mask(const char *block)
+{
+	__m256i c = _mm256_loadu_si256((const __m256i *)block);
+
+	return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n')));
+}
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define WS_BLOCK 16
+
+static inline uint32_t whitespace_mask(const char *block)
+{
+	__m128i c = _mm_loadu_si128((const __m128i *)block);
+	__m128i space = _mm_cmpeq_epi8(c, _mm_set1_epi8(' '));
+	__m128i ctrl = _mm_sub_epi8(c, _mm_set1_epi8('\t'));
+
+	ctrl = _mm_cmpeq_epi8(_mm_min_epu8(ctrl, _mm_set1_epi8('\r' - '\t')), ctrl);
+	return (uint32_t)_mm_movemask_epi8(_mm_or_si128(space, ctrl));
+}
+
+static inline uint32_t newline_mask(const char *block)
+{
+	__m128i c = _mm_loadu_si128((const __m128i *)block);
+
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n')));
+}
+#endif
+
+#ifdef WS_BLOCK
+#define WS_BLOCK_MASK ((uint32_t)(((uint64_t)1 << WS_BLOCK) - 1))
+#endif
+
+#endif